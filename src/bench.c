@@ -0,0 +1,177 @@
+/*  This file is part of Cellbowl.
+
+    Cellbowl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Cellbowl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Cellbowl.  If not, see <https://www.gnu.org/licenses/>. 
+    
+    © Tom Rodgers 2010-2019
+*/
+#include <string.h>
+
+#include "world.h"
+#include "profile.h"
+
+#define BENCH_DEFAULT_STEPS 2000
+#define BENCH_DEFAULT_SEED 1
+#define NUM_BENCH_STATES 5
+
+// replays the shipped state files headless with a fixed step and prints the
+// step rate and time spent in each phase as JSON
+static void print_usage(char *name) {
+    fprintf(stderr, "Usage: %s [--steps N] [--step-ms MS] [--seed SEED] [--threads N] [--dir DIR] [--all-broadphases]\n"
+            "       [world options]\n"
+            "  --steps N      steps to run from each state (default %d)\n"
+            "  --step-ms MS   simulated milliseconds per step (default %d)\n"
+            "  --seed SEED    seed used before each state (default %d)\n"
+            "  --threads N    threads to step the world on (default 1)\n"
+            "  --dir DIR      directory holding state0 to state%d (default .)\n"
+            "  --all-broadphases\n"
+            "                 run each state with every broadphase in turn instead of only the chosen one\n",
+            name, BENCH_DEFAULT_STEPS, DEFAULT_STEP_MS, BENCH_DEFAULT_SEED, NUM_BENCH_STATES - 1);
+    print_world_options(stderr);
+}
+
+int main(int argc, char *argv[]) {
+    int i, j, k;
+    long steps = BENCH_DEFAULT_STEPS;
+    int step_ms = DEFAULT_STEP_MS;
+    unsigned int seed = BENCH_DEFAULT_SEED;
+    int threads = 1;
+    char *dir = ".";
+    int all_broadphases = 0;
+    WorldConfig config;
+    default_world_config(&config);
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--steps") && i + 1 < argc) {
+            steps = strtol(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--step-ms") && i + 1 < argc) {
+            step_ms = strtol(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = strtol(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--dir") && i + 1 < argc) {
+            dir = argv[++i];
+        } else if (!strcmp(argv[i], "--all-broadphases")) {
+            all_broadphases = 1;
+        } else if (!parse_world_option(&config, argc, argv, &i)) {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (steps <= 0 || step_ms <= 0 || threads <= 0 || !check_world_config(&config)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // one world for each broadphase run, which all find the same pairs and so end up the same
+    World *worlds[NUM_BROADPHASES];
+    BroadphaseKind kinds[NUM_BROADPHASES];
+    BroadphaseKind kind;
+    int num_kinds = 0;
+    for (kind = 0; kind < NUM_BROADPHASES; kind++) {
+        if (!all_broadphases && kind != config.broadphase) continue;
+        kinds[num_kinds] = kind;
+        config.broadphase = kind;
+        srand(seed);
+        worlds[num_kinds] = create_world(&config, threads, seed);
+        if (worlds[num_kinds] == NULL) {
+            fprintf(stderr, "Could not allocate world\n");
+            while (num_kinds--) {
+                free_world(worlds[num_kinds]);
+            }
+            return 1;
+        }
+        num_kinds++;
+    }
+
+    printf("{\n");
+    printf("  \"steps\": %ld,\n", steps);
+    printf("  \"step_ms\": %d,\n", step_ms);
+    printf("  \"seed\": %u,\n", seed);
+    printf("  \"kernel\": \"%s\",\n", kinematics_kernel_name());
+    printf("  \"threads\": %d,\n", worlds[0]->workers.num_threads);
+    printf("  \"area\": [%d, %d],\n", config.width, config.height);
+    printf("  \"max_cells\": %d,\n", config.max_cells);
+    printf("  \"sort_steps\": %d,\n", config.sort_steps);
+    printf("  \"broadphases\": [");
+    for (k = 0; k < num_kinds; k++) {
+        printf("%s\"%s\"", k ? ", " : "", broadphase_names[kinds[k]]);
+    }
+    printf("],\n");
+    printf("  \"skin\": %d,\n", config.skin);
+#ifdef CELLBOWL_PROFILE
+    printf("  \"profile\": true,\n");
+#else
+    printf("  \"profile\": false,\n");
+#endif
+    printf("  \"states\": [");
+    int first = 1;
+    int failed = 0;
+    for (i = 0; i < NUM_BENCH_STATES && !failed; i++) {
+        char filename[4096];
+        snprintf(filename, sizeof(filename), "%s/state%d", dir, i);
+        for (k = 0; k < num_kinds; k++) {
+            World *world = worlds[k];
+            if (!load_state_file(world, filename)) {
+                fprintf(stderr, "Skipping %s, could not open it\n", filename);
+                break;
+            }
+            srand(seed);
+            int initial_cells = world->num_cells;
+            unsigned long long allocs = world->pool.allocs;
+            unsigned long long frees = world->pool.frees;
+            unsigned long long slabs = world->pool.slab_allocs;
+            unsigned long long large_allocs = world->pool.large_allocs;
+            unsigned long rebuilds = count_broadphase_rebuilds(&world->broadphase);
+            long step;
+            reset_profile();
+            unsigned long long start = get_time_ns();
+            for (step = 0; step < steps; step++) {
+                if (!step_world(world, step_ms)) {
+                    fprintf(stderr, "Out of memory for collisions in %s at step %ld\n", filename, step);
+                    failed = 1;
+                    break;
+                }
+            }
+            // a run that stopped short isn't worth timing, so leave it out and stop there
+            if (failed) break;
+            double wall = (get_time_ns() - start) / 1e9;
+
+            printf("%s\n    {\n", first ? "" : ",");
+            first = 0;
+            printf("      \"name\": \"state%d\",\n", i);
+            printf("      \"broadphase\": \"%s\",\n", broadphase_names[kinds[k]]);
+            printf("      \"initial_cells\": %d,\n", initial_cells);
+            printf("      \"final_cells\": %d,\n", world->num_cells);
+            printf("      \"wall_s\": %.6f,\n", wall);
+            printf("      \"steps_per_s\": %.1f,\n", wall > 0 ? steps / wall : 0.0);
+            printf("      \"pool\": {\"allocs\": %llu, \"frees\": %llu, \"slabs\": %llu, \"large_allocs\": %llu, \"live_kb\": %.1f},\n",
+                    world->pool.allocs - allocs, world->pool.frees - frees, world->pool.slab_allocs - slabs,
+                    world->pool.large_allocs - large_allocs, world->pool.live_bytes / 1024.0);
+            // neighbour list builds or full sorts of the sweep
+            printf("      \"broadphase_rebuilds\": %lu,\n", count_broadphase_rebuilds(&world->broadphase) - rebuilds);
+            printf("      \"phases\": {");
+            for (j = 0; j < NUM_STEP_PROFILE_PHASES; j++) {
+                printf("%s\n        \"%s\": {\"total_ms\": %.3f, \"per_step_us\": %.3f}", j ? "," : "",
+                        profile_phase_names[j], profile_phase_ns[j] / 1e6, profile_phase_ns[j] / 1e3 / steps);
+            }
+            printf("\n      }\n    }");
+        }
+    }
+    printf("\n  ]\n}\n");
+
+    for (k = 0; k < num_kinds; k++) {
+        free_world(worlds[k]);
+    }
+    return failed;
+}
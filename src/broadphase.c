@@ -0,0 +1,468 @@
+/*  This file is part of Cellbowl.
+
+    Cellbowl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Cellbowl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Cellbowl.  If not, see <https://www.gnu.org/licenses/>. 
+    
+    © Tom Rodgers 2010-2019
+*/
+#include <string.h>
+
+#include "cell.h"
+#include "broadphase.h"
+
+const char *broadphase_names[NUM_BROADPHASES] = {"grid", "verlet", "sweep"};
+
+int find_broadphase(const char *name) {
+    int i;
+    for (i = 0; i < NUM_BROADPHASES; i++) {
+        if (!strcmp(name, broadphase_names[i])) return i;
+    }
+    return -1;
+}
+
+static void free_neighbour_list(NeighbourList *list) {
+    free_spatial_hash(&list->grid);
+    free(list->built);
+    free(list->added);
+    free(list->candidates);
+    free(list->found);
+    free(list->counts);
+    free(list->ref_x);
+    free(list->ref_y);
+}
+
+static int create_neighbour_list(NeighbourList *list, int width, int height, int min_bucket_size, int skin,
+        int capacity) {
+    if (!create_spatial_hash(&list->grid, width, height, min_bucket_size, capacity)) return 0;
+    list->skin = skin;
+    list->min_bucket_size = min_bucket_size;
+    list->built = malloc(sizeof(*list->built) * capacity);
+    list->added = malloc(sizeof(*list->added) * MAX_NEIGHBOURS_ADDED);
+    list->num_added = 0;
+    list->max_r = 0;
+    list->num_candidates = 0;
+    list->candidates_allocated = capacity * 4;
+    list->candidates = malloc(sizeof(*list->candidates) * list->candidates_allocated);
+    list->found_allocated = list->candidates_allocated;
+    list->found = malloc(sizeof(*list->found) * list->found_allocated);
+    list->counts = malloc(sizeof(*list->counts) * (capacity + 1));
+    list->refs_allocated = capacity;
+    list->ref_x = malloc(sizeof(*list->ref_x) * capacity);
+    list->ref_y = malloc(sizeof(*list->ref_y) * capacity);
+    list->next_id = 0;
+    list->stale = 1;
+    list->builds = 0;
+    if (!(list->built && list->added && list->candidates && list->found && list->counts && list->ref_x &&
+                list->ref_y)) {
+        free_neighbour_list(list);
+        return 0;
+    }
+    return 1;
+}
+
+static int create_sweep_list(SweepList *sweep, int capacity) {
+    sweep->entries = malloc(sizeof(*sweep->entries) * capacity);
+    if (sweep->entries == NULL) return 0;
+    sweep->num_entries = 0;
+    sweep->entries_allocated = capacity;
+    sweep->next_id = 0;
+    sweep->stale = 1;
+    sweep->sorts = 0;
+    return 1;
+}
+
+int create_broadphase(Broadphase *broadphase, BroadphaseKind kind, int width, int height, int min_bucket_size,
+        int skin, int capacity) {
+    broadphase->kind = kind;
+    switch (kind) {
+        case BROADPHASE_VERLET:
+            return create_neighbour_list(&broadphase->neighbours, width, height, min_bucket_size, skin, capacity);
+        case BROADPHASE_SWEEP:
+            return create_sweep_list(&broadphase->sweep, capacity);
+        default:
+            return 1;
+    }
+}
+
+int grow_broadphase(Broadphase *broadphase, int capacity) {
+    if (broadphase->kind == BROADPHASE_VERLET) {
+        NeighbourList *list = &broadphase->neighbours;
+        if (!grow_spatial_hash(&list->grid, capacity)) return 0;
+        if (capacity > list->refs_allocated) {
+            CellHandle *built = realloc(list->built, sizeof(*built) * capacity);
+            if (built == NULL) return 0;
+            list->built = built;
+            int *counts = realloc(list->counts, sizeof(*counts) * (capacity + 1));
+            if (counts == NULL) return 0;
+            list->counts = counts;
+            int *ref_x = realloc(list->ref_x, sizeof(*ref_x) * capacity);
+            if (ref_x == NULL) return 0;
+            list->ref_x = ref_x;
+            int *ref_y = realloc(list->ref_y, sizeof(*ref_y) * capacity);
+            if (ref_y == NULL) return 0;
+            list->ref_y = ref_y;
+            list->refs_allocated = capacity;
+        }
+    } else if (broadphase->kind == BROADPHASE_SWEEP && capacity > broadphase->sweep.entries_allocated) {
+        SweepList *sweep = &broadphase->sweep;
+        SweepEntry *entries = realloc(sweep->entries, sizeof(*entries) * capacity);
+        if (entries == NULL) return 0;
+        sweep->entries = entries;
+        sweep->entries_allocated = capacity;
+    }
+    return 1;
+}
+
+void free_broadphase(Broadphase *broadphase) {
+    if (broadphase->kind == BROADPHASE_VERLET) {
+        free_neighbour_list(&broadphase->neighbours);
+    } else if (broadphase->kind == BROADPHASE_SWEEP) {
+        free(broadphase->sweep.entries);
+    }
+}
+
+void invalidate_broadphase(Broadphase *broadphase) {
+    if (broadphase->kind == BROADPHASE_VERLET) {
+        broadphase->neighbours.stale = 1;
+    } else if (broadphase->kind == BROADPHASE_SWEEP) {
+        broadphase->sweep.stale = 1;
+    }
+}
+
+unsigned long count_broadphase_rebuilds(const Broadphase *broadphase) {
+    switch (broadphase->kind) {
+        case BROADPHASE_VERLET:
+            return broadphase->neighbours.builds;
+        case BROADPHASE_SWEEP:
+            return broadphase->sweep.sorts;
+        default:
+            return 0;
+    }
+}
+
+static int add_candidate(NeighbourList *list, CellHandle a, CellHandle b) {
+    if (list->num_candidates == list->candidates_allocated) {
+        HandlePair *candidates = realloc(list->candidates, sizeof(*candidates) * list->candidates_allocated * 2);
+        if (candidates == NULL) return 0;
+        list->candidates = candidates;
+        list->candidates_allocated *= 2;
+    }
+    list->candidates[list->num_candidates].a = a;
+    list->candidates[list->num_candidates].b = b;
+    list->num_candidates++;
+    return 1;
+}
+
+// the neighbouring buckets to the right of and below a bucket
+static const int neighbour_cols[4] = {1, -1, 0, 1};
+static const int neighbour_rows[4] = {0, 1, 1, 1};
+
+// adds a and b to the pairs found if their unscaled bounding circles, whose radii are in the
+// grid, are within the skin
+static int add_found(NeighbourList *list, Kinematics *kin, int a, int b) {
+    int dx = kin->x[a] - kin->x[b];
+    int dy = kin->y[a] - kin->y[b];
+    int rs = list->grid.radii[a] + list->grid.radii[b] + list->skin;
+    if (dx * dx + dy * dy >= rs * rs) return 1;
+    if (list->num_candidates == list->found_allocated) {
+        CellPair *found = realloc(list->found, sizeof(*found) * list->found_allocated * 2);
+        if (found == NULL) return 0;
+        list->found = found;
+        list->found_allocated *= 2;
+    }
+    list->found[list->num_candidates].a = a < b ? a : b;
+    list->found[list->num_candidates].b = a < b ? b : a;
+    list->num_candidates++;
+    return 1;
+}
+
+// lists every pair whose unscaled bounding circles are within the skin of each other. cells are never
+// larger than their unscaled radius, so these are the only pairs that can overlap until something moves
+static int build_neighbours(NeighbourList *list, Cell *cells, Kinematics *kin, int num_cells,
+        const HandleTable *handles) {
+    int i, j, k, l, n;
+    int complete = 1;
+    SpatialHash *grid = &list->grid;
+    // buckets wide enough that every pair within reach is in the same or neighbouring buckets
+    list->max_r = 0;
+    for (i = 0; i < num_cells; i++) {
+        grid->radii[i] = cells[i].genome->r;
+        if (grid->radii[i] > list->max_r) {
+            list->max_r = grid->radii[i];
+        }
+    }
+    grid->min_bucket_size = 2 * list->max_r + list->skin;
+    if (grid->min_bucket_size < list->min_bucket_size) {
+        grid->min_bucket_size = list->min_bucket_size;
+    }
+    build_spatial_hash(grid, cells, kin, num_cells);
+    list->num_candidates = 0;
+    // each bucket with itself and the neighbours after it, as find_spatial_pairs does
+    for (j = 0; j < grid->rows; j++) {
+        for (i = 0; i < grid->cols; i++) {
+            int b = j * grid->cols + i;
+            if (grid->starts[b] == grid->starts[b + 1]) continue;
+            for (k = grid->starts[b]; k < grid->starts[b + 1]; k++) {
+                for (l = k + 1; l < grid->starts[b + 1]; l++) {
+                    complete &= add_found(list, kin, grid->entries[k], grid->entries[l]);
+                }
+            }
+            for (n = 0; n < 4; n++) {
+                int ni = i + neighbour_cols[n];
+                int nj = j + neighbour_rows[n];
+                if (ni < 0 || ni >= grid->cols || nj >= grid->rows) continue;
+                int nb = nj * grid->cols + ni;
+                for (k = grid->starts[b]; k < grid->starts[b + 1]; k++) {
+                    for (l = grid->starts[nb]; l < grid->starts[nb + 1]; l++) {
+                        complete &= add_found(list, kin, grid->entries[k], grid->entries[l]);
+                    }
+                }
+            }
+        }
+    }
+    if (list->num_candidates > list->candidates_allocated) {
+        HandlePair *candidates = realloc(list->candidates, sizeof(*candidates) * list->found_allocated);
+        if (candidates == NULL) {
+            list->num_candidates = list->candidates_allocated;
+            complete = 0;
+        } else {
+            list->candidates = candidates;
+            list->candidates_allocated = list->found_allocated;
+        }
+    }
+    // order the pairs by index with a counting sort on the first cell and an insertion sort on the
+    // second, so they come out sorted each step until cells move in the array
+    for (i = 0; i <= num_cells; i++) {
+        list->counts[i] = 0;
+    }
+    for (k = 0; k < list->num_candidates; k++) {
+        list->counts[list->found[k].a]++;
+    }
+    for (i = 1; i <= num_cells; i++) {
+        list->counts[i] += list->counts[i - 1];
+    }
+    // fill each run from the back, leaving counts at the beginning of each run
+    for (k = list->num_candidates - 1; k >= 0; k--) {
+        int slot = --list->counts[list->found[k].a];
+        list->candidates[slot].a = cells[list->found[k].a].handle;
+        list->candidates[slot].b = cells[list->found[k].b].handle;
+    }
+    for (i = 0; i < num_cells; i++) {
+        for (k = list->counts[i] + 1; k < list->counts[i + 1]; k++) {
+            HandlePair pair = list->candidates[k];
+            int index = find_handle(handles, pair.b);
+            for (l = k; l > list->counts[i] && find_handle(handles, list->candidates[l - 1].b) > index; l--) {
+                list->candidates[l] = list->candidates[l - 1];
+            }
+            list->candidates[l] = pair;
+        }
+    }
+    for (i = 0; i < num_cells; i++) {
+        list->built[i] = cells[i].handle;
+        list->ref_x[cells[i].handle.slot] = kin->x[i];
+        list->ref_y[cells[i].handle.slot] = kin->y[i];
+    }
+    list->num_added = 0;
+    list->next_id = handles->next_id;
+    // a list missing pairs would go on missing them, so build it again next time
+    list->stale = !complete;
+    list->builds++;
+    return complete;
+}
+
+// whether the listed cell with handle other, last at index, is within reach of cell i where it is now
+static int near_listed(NeighbourList *list, Cell *cells, Kinematics *kin, int i, CellHandle other, int index) {
+    int dx = kin->x[i] - list->ref_x[other.slot];
+    int dy = kin->y[i] - list->ref_y[other.slot];
+    int rs = cells[i].genome->r + cells[index].genome->r + list->skin;
+    return dx * dx + dy * dy < rs * rs;
+}
+
+// lists a child born since the last build against the cells where they were when they were listed,
+// which keeps every pair left off the list apart while both stay within half the skin of there
+static int add_neighbour(NeighbourList *list, Cell *cells, Kinematics *kin, int i, const HandleTable *handles) {
+    int j, k, l;
+    int complete = 1;
+    SpatialHash *grid = &list->grid;
+    int r = cells[i].genome->r;
+    if (r > list->max_r) {
+        list->max_r = r;
+    }
+    int reach = r + list->max_r + list->skin;
+    int left = spatial_col(grid, kin->x[i] - reach);
+    int top = spatial_row(grid, kin->y[i] - reach);
+    int right = spatial_col(grid, kin->x[i] + reach);
+    int bottom = spatial_row(grid, kin->y[i] + reach);
+    for (k = top; k <= bottom; k++) {
+        for (j = left; j <= right; j++) {
+            int b = k * grid->cols + j;
+            for (l = grid->starts[b]; l < grid->starts[b + 1]; l++) {
+                CellHandle other = list->built[grid->entries[l]];
+                int index = find_handle(handles, other);
+                if (index >= 0 && near_listed(list, cells, kin, i, other, index)) {
+                    complete &= add_candidate(list, cells[i].handle, other);
+                }
+            }
+        }
+    }
+    for (k = 0; k < list->num_added; k++) {
+        int index = find_handle(handles, list->added[k]);
+        if (index >= 0 && near_listed(list, cells, kin, i, list->added[k], index)) {
+            complete &= add_candidate(list, cells[i].handle, list->added[k]);
+        }
+    }
+    list->added[list->num_added++] = cells[i].handle;
+    list->ref_x[cells[i].handle.slot] = kin->x[i];
+    list->ref_y[cells[i].handle.slot] = kin->y[i];
+    return complete;
+}
+
+// builds the list again if any cell is more than half the skin from where it was listed,
+// otherwise lists the cells born since it was last brought up to date
+static int update_neighbours(NeighbourList *list, Cell *cells, Kinematics *kin, int num_cells,
+        const HandleTable *handles) {
+    int i;
+    int born = 0;
+    int complete = 1;
+    if (list->stale) return build_neighbours(list, cells, kin, num_cells, handles);
+    for (i = 0; i < num_cells; i++) {
+        if (cells[i].id >= list->next_id) {
+            born++;
+            continue;
+        }
+        int dx = kin->x[i] - list->ref_x[cells[i].handle.slot];
+        int dy = kin->y[i] - list->ref_y[cells[i].handle.slot];
+        if (4 * (dx * dx + dy * dy) > list->skin * list->skin) {
+            return build_neighbours(list, cells, kin, num_cells, handles);
+        }
+    }
+    if (!born) return 1;
+    if (list->num_added + born > MAX_NEIGHBOURS_ADDED) {
+        return build_neighbours(list, cells, kin, num_cells, handles);
+    }
+    for (i = 0; i < num_cells; i++) {
+        if (cells[i].id >= list->next_id) {
+            complete &= add_neighbour(list, cells, kin, i, handles);
+        }
+    }
+    list->next_id = handles->next_id;
+    list->stale = !complete;
+    return complete;
+}
+
+static int find_neighbour_pairs(NeighbourList *list, SpatialHash *hash, Cell *cells, Kinematics *kin,
+        int num_cells, const HandleTable *handles) {
+    int i;
+    int complete = update_neighbours(list, cells, kin, num_cells, handles);
+    set_spatial_radii(hash, cells, num_cells);
+    hash->num_pairs = 0;
+    // test what is left of the list, dropping pairs with a cell that has died
+    int kept = 0;
+    for (i = 0; i < list->num_candidates; i++) {
+        int a = find_handle(handles, list->candidates[i].a);
+        int b = find_handle(handles, list->candidates[i].b);
+        if (a < 0 || b < 0) continue;
+        list->candidates[kept++] = list->candidates[i];
+        complete &= add_spatial_pair(hash, kin, a, b);
+    }
+    list->num_candidates = kept;
+    sort_spatial_pairs(hash);
+    return complete;
+}
+
+static int compare_sweep_entries(const void *p, const void *q) {
+    const SweepEntry *a = p;
+    const SweepEntry *b = q;
+    if (a->left != b->left) return a->left < b->left ? -1 : 1;
+    return 0;
+}
+
+// brings the order up to date with the cells as they are now: drops those that died, adds those
+// born at the end and sorts it again, by insertion unless it has been upset too much for that
+static void update_sweep(SweepList *sweep, SpatialHash *hash, Cell *cells, Kinematics *kin, int num_cells,
+        const HandleTable *handles) {
+    int i, j;
+    int born = 0;
+    if (sweep->stale) {
+        for (i = 0; i < num_cells; i++) {
+            sweep->entries[i].handle = cells[i].handle;
+        }
+    } else {
+        int kept = 0;
+        for (i = 0; i < sweep->num_entries; i++) {
+            if (find_handle(handles, sweep->entries[i].handle) >= 0) {
+                sweep->entries[kept++] = sweep->entries[i];
+            }
+        }
+        for (i = 0; i < num_cells; i++) {
+            if (cells[i].id >= sweep->next_id) {
+                sweep->entries[kept + born++].handle = cells[i].handle;
+            }
+        }
+    }
+    sweep->num_entries = num_cells;
+    for (i = 0; i < num_cells; i++) {
+        SweepEntry *entry = sweep->entries + i;
+        entry->index = find_handle(handles, entry->handle);
+        entry->left = kin->x[entry->index] - hash->radii[entry->index];
+    }
+    if (sweep->stale || born > MAX_SWEEP_ADDED) {
+        qsort(sweep->entries, num_cells, sizeof(*sweep->entries), compare_sweep_entries);
+        sweep->sorts++;
+    } else {
+        for (i = 1; i < num_cells; i++) {
+            SweepEntry entry = sweep->entries[i];
+            for (j = i; j > 0 && sweep->entries[j - 1].left > entry.left; j--) {
+                sweep->entries[j] = sweep->entries[j - 1];
+            }
+            sweep->entries[j] = entry;
+        }
+    }
+    sweep->next_id = handles->next_id;
+    sweep->stale = 0;
+}
+
+static int find_sweep_pairs(SweepList *sweep, SpatialHash *hash, Cell *cells, Kinematics *kin, int num_cells,
+        const HandleTable *handles) {
+    int i, j;
+    int complete = 1;
+    set_spatial_radii(hash, cells, num_cells);
+    update_sweep(sweep, hash, cells, kin, num_cells, handles);
+    hash->num_pairs = 0;
+    // circles can only overlap if their spans of x do, and the spans that overlap a cell's and start
+    // after it are the ones that start before its right edge
+    for (i = 0; i < num_cells; i++) {
+        int a = sweep->entries[i].index;
+        int right = kin->x[a] + hash->radii[a];
+        for (j = i + 1; j < num_cells && sweep->entries[j].left < right; j++) {
+            complete &= add_spatial_pair(hash, kin, a, sweep->entries[j].index);
+        }
+    }
+    sort_spatial_pairs(hash);
+    return complete;
+}
+
+int find_broadphase_pairs(Broadphase *broadphase, SpatialHash *hash, Cell *cells, Kinematics *kin,
+        int num_cells, const HandleTable *handles) {
+    switch (broadphase->kind) {
+        case BROADPHASE_VERLET:
+            return find_neighbour_pairs(&broadphase->neighbours, hash, cells, kin, num_cells, handles);
+        case BROADPHASE_SWEEP:
+            return find_sweep_pairs(&broadphase->sweep, hash, cells, kin, num_cells, handles);
+        default:
+            // the buckets were filled before the cells moved this step, and a pair that has closed
+            // in from two buckets apart would be missed
+            build_spatial_hash(hash, cells, kin, num_cells);
+            return find_spatial_pairs(hash, cells, kin, num_cells);
+    }
+}
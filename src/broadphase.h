@@ -0,0 +1,112 @@
+/*  This file is part of Cellbowl.
+
+    Cellbowl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Cellbowl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Cellbowl.  If not, see <https://www.gnu.org/licenses/>. 
+    
+    © Tom Rodgers 2010-2019
+*/
+#ifndef BROADPHASE_H
+#define BROADPHASE_H
+
+#include "kinematics.h"
+#include "spatial.h"
+#include "handle.h"
+
+struct Cell;
+
+// ways of finding the pairs of cells that might touch, chosen when the world is created
+typedef enum BroadphaseKind {
+    BROADPHASE_GRID, // every pair in neighbouring buckets of the spatial hash, every step
+    BROADPHASE_VERLET, // a list of nearby pairs kept from step to step
+    BROADPHASE_SWEEP, // the cells kept in order of their left edges, swept for overlaps every step
+    NUM_BROADPHASES
+} BroadphaseKind;
+
+extern const char *broadphase_names[NUM_BROADPHASES];
+
+// cells born since the neighbour list was built are searched one by one, so past this many it is built again
+#define MAX_NEIGHBOURS_ADDED 64
+// children are sorted into the sweep by insertion from the end, so past this many at once it is sorted in full
+#define MAX_SWEEP_ADDED 64
+
+// two cells that were within reach of each other when the list was built
+typedef struct HandlePair {
+    CellHandle a, b;
+} HandlePair;
+
+// the pairs of cells whose bounding circles came within skin pixels of each other, listed by handle
+// so sorting and deaths leave it valid. while no cell is more than half the skin from where it was
+// when it was listed, no pair left off it can overlap. children are listed as they are born
+typedef struct NeighbourList {
+    int skin;
+    int min_bucket_size; // of the world, which the grid's buckets are made no smaller than
+    SpatialHash grid; // of the cells where they were at the last build
+    CellHandle *built; // the cell at each index in the grid
+    CellHandle *added; // cells born since the last build
+    int num_added;
+    int max_r; // largest unscaled radius of any listed cell
+    HandlePair *candidates;
+    int num_candidates, candidates_allocated;
+    CellPair *found; // candidates by index while the list is built, before they are ordered
+    int found_allocated;
+    int *counts; // of candidates by their first cell while the list is built
+    int *ref_x, *ref_y; // where each cell was when it was listed, by handle slot
+    int refs_allocated;
+    unsigned long long next_id; // of the handle table when the list was last brought up to date
+    int stale; // the list has to be built again before it is used
+    unsigned long builds;
+} NeighbourList;
+
+// a cell in the sweep order
+typedef struct SweepEntry {
+    CellHandle handle;
+    int index; // in the cell array this step
+    int left; // edge of the energy-scaled bounding circle this step
+} SweepEntry;
+
+// every cell in order of the left edge of its bounding circle, kept by handle from step to step. cells
+// move little in a step, so sorting it again by insertion only has a few short moves to make
+typedef struct SweepList {
+    SweepEntry *entries;
+    int num_entries, entries_allocated;
+    unsigned long long next_id; // of the handle table when the cells born were last added
+    int stale; // the order has to be sorted from scratch before it is used
+    unsigned long sorts; // from scratch
+} SweepList;
+
+typedef struct Broadphase {
+    BroadphaseKind kind;
+    NeighbourList neighbours; // only allocated for BROADPHASE_VERLET
+    SweepList sweep; // only allocated for BROADPHASE_SWEEP
+} Broadphase;
+
+// returns the kind with the given name, or -1 if there isn't one
+int find_broadphase(const char *name);
+// a broadphase of the given kind over a width by height area, with room for capacity cells.
+// skin is the margin of the neighbour lists in pixels. returns 0 if it could not be allocated
+int create_broadphase(Broadphase *broadphase, BroadphaseKind kind, int width, int height, int min_bucket_size,
+        int skin, int capacity);
+// makes room for capacity cells. returns 0 if it could not grow, leaving it as it was
+int grow_broadphase(Broadphase *broadphase, int capacity);
+void free_broadphase(Broadphase *broadphase);
+// forgets what it knows of the cells, after they have all been replaced
+void invalidate_broadphase(Broadphase *broadphase);
+// times the neighbour lists have been built or the sweep sorted from scratch
+unsigned long count_broadphase_rebuilds(const Broadphase *broadphase);
+// lists each pair of cells whose bounding circles overlap exactly once into the pairs of hash,
+// sorted as find_spatial_pairs sorts them, so every kind finds the same pairs. the grid builds
+// hash again from where the cells are now. returns 0 if some list couldn't grow and the pairs are incomplete
+int find_broadphase_pairs(Broadphase *broadphase, SpatialHash *hash, struct Cell *cells, Kinematics *kin,
+        int num_cells, const HandleTable *handles);
+
+#endif
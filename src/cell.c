@@ -16,32 +16,27 @@
     © Tom Rodgers 2010-2019
 */
 #include "cell.h"
+#include "broadphase.h"
 
-void add_initial_cells(Cell cells[MAX_CELLS]) {
+void register_cell(Cell *cell, HandleTable *handles, int index) {
+    cell->id = handles->next_id++;
+    cell->handle = add_handle(handles, index);
+}
+
+void add_initial_cells(Cell *cells, Kinematics *kin, Pool *pool, HandleTable *handles, int width, int height) {
     int i, j, k;
-    for (i = 0; i < AREA_WIDTH / CELL_SPACE; i++) {
-        for (j = 0; j < AREA_HEIGHT / CELL_SPACE; j++) {
+    for (i = 0; i < width / CELL_SPACE; i++) {
+        for (j = 0; j < height / CELL_SPACE; j++) {
             Cell tmp_cell;
-            tmp_cell.x = i*CELL_SPACE + CELL_SPACE/2;
-            tmp_cell.y = j*CELL_SPACE + CELL_SPACE/2;
-            tmp_cell.x_err = 0;
-            tmp_cell.y_err = 0;
-            tmp_cell.x_vel = 0;
-            tmp_cell.y_vel = 0;
-            tmp_cell.rot = 0;
-            tmp_cell.rot_vel = 0;
+            reset_kinematics(kin, i * (height / CELL_SPACE) + j,
+                    i*CELL_SPACE + CELL_SPACE/2, j*CELL_SPACE + CELL_SPACE/2, 0);
             tmp_cell.mov_counter = 0;
             tmp_cell.rot_counter = 0;
-            tmp_cell.pause_motion = 0;
             tmp_cell.e = 500000;
             tmp_cell.age = 0;
-            for (k = 0; k < NUM_TYPES; k++) {
-                tmp_cell.type_counts[k] = 0;
-            }
             tmp_cell.virus = NULL;
-            tmp_cell.num_organelles = rand() % 3 + 5;
-            tmp_cell.organelles = malloc(sizeof(Organelle) * tmp_cell.num_organelles);
-            for (k = 0; k < tmp_cell.num_organelles; k++) {
+            tmp_cell.genome = create_genome(rand() % 3 + 5, pool);
+            for (k = 0; k < tmp_cell.genome->num_organelles; k++) {
                 Organelle tmp_organelle;
                 if (k) {
                     tmp_organelle.r = 4 + rand() % 4;
@@ -55,211 +50,107 @@ void add_initial_cells(Cell cells[MAX_CELLS]) {
                 } else {
                     tmp_organelle.parent_id = -1;
                 }
-                tmp_organelle.x = 0;
-                tmp_organelle.y = 0;
-                tmp_organelle.num_children = 0;
-                tmp_organelle.children = NULL;
-                tmp_cell.organelles[k] = tmp_organelle;
+                tmp_cell.genome->organelles[k] = tmp_organelle;
             }
+            set_genome_variables(tmp_cell.genome);
             tmp_cell.state = 0;
             tmp_cell.state_counter = 0;
-            set_secondary_variables(&tmp_cell);
-            cells[i * (AREA_HEIGHT / CELL_SPACE) + j] = tmp_cell;
+            create_organelle_locs(&tmp_cell, pool);
+            cells[i * (height / CELL_SPACE) + j] = tmp_cell;
+            register_cell(cells + i * (height / CELL_SPACE) + j, handles, i * (height / CELL_SPACE) + j);
         }
     }
 }
 
-void set_organelle_loc(Organelle *cur_organelle, double parent_x, double parent_y, int parent_r, double cell_rot, int cell_e) {
-    int cur_r = energy_scale(cur_organelle->r, cell_e);
-    double cur_x = parent_x + (parent_r + cur_r) * cos(cur_organelle->angle + cell_rot);
-    double cur_y = parent_y + (parent_r + cur_r) * sin(cur_organelle->angle + cell_rot);
-    cur_organelle->x = cur_x;
-    cur_organelle->y = cur_y;
+void locate_organelles(const Genome *genome, long e, double rot, int *x, int *y, int *r) {
     int i;
-    for (i = 0; i < cur_organelle->num_children; i++) {
-        set_organelle_loc(cur_organelle->children[i], cur_x, cur_y, cur_r, cell_rot, cell_e);
+    double capped_e = e;
+    if (capped_e > 1000000) {
+        capped_e = 1000000;
+    } else if (capped_e < -500000) {
+        capped_e = -500000;
+    }
+    // one rotation and one scale take every organelle from its full energy layout to its current one
+    double scale = (capped_e + 500000) / 1500000;
+    double c = cos(rot) * scale;
+    double s = sin(rot) * scale;
+    for (i = 0; i < genome->num_organelles; i++) {
+        x[i] = genome->organelles[i].base_x * c - genome->organelles[i].base_y * s;
+        y[i] = genome->organelles[i].base_x * s + genome->organelles[i].base_y * c;
+        r[i] = energy_scale(genome->organelles[i].r, e);
     }
 }
 
-void set_secondary_variables(Cell *cell) {
-    int i, j;
-    for (i = 0; i < cell->num_organelles; i++) {
-        cell->organelles[i].num_children = 0;
-    }
-    for (i = 1; i < cell->num_organelles; i++) {
-        cell->organelles[cell->organelles[i].parent_id].num_children++;
-    }
-    for (i = 0; i < cell->num_organelles; i++) {
-        cell->organelles[i].children = malloc(cell->organelles[i].num_children * sizeof(*cell->organelles[i].children));
-        int cur_child = 0;
-        for (j = 1; j < cell->num_organelles; j++) {
-            if (cell->organelles[j].parent_id == i) {
-                cell->organelles[i].children[cur_child] = cell->organelles + j;
-                cur_child++;
-            }
-        }
-    }
-    for (i = 0; i < NUM_TYPES; i++) {
-        cell->type_counts[i] = 0;
-    }
-    set_organelle_loc(cell->organelles, 0, 0, -cell->organelles->r, 0, 1000000);
-    cell->r = 0;
-    for (i = 0; i < cell->num_organelles; i++) {
-        int cur_r = ceil(sqrt(cell->organelles[i].x*cell->organelles[i].x +
-                    cell->organelles[i].y*cell->organelles[i].y)) + cell->organelles[i].r;
-        if (cur_r > cell->r) {
-            cell->r = cur_r;
-        }
-        cell->type_counts[cell->organelles[i].type] += cell->organelles[i].r;
-    }
-    cell->primary_type = 0;
-    for (i = 0; i < NUM_TYPES; i++) {
-        if (cell->type_counts[i] >= cell->type_counts[cell->primary_type]) {
-            cell->primary_type = i;
-        }
-    }
-    cell->weight = 1;
-    cell->weight += cell->type_counts[0] * 3 / 2;
-    cell->weight += cell->type_counts[1] * 3 / 2;
-    cell->weight += cell->type_counts[2] * 3 / 2;
-    cell->weight += cell->type_counts[3] / 5;
-    cell->weight += cell->type_counts[4] * 5 / 9;
-    cell->weight += cell->type_counts[5] * 5 / 9;
-    cell->weight += cell->type_counts[6] * 5 / 9;
-    cell->weight += cell->type_counts[7];
-    cell->weight += cell->type_counts[8] * 4 / 5;
+void set_organelle_locs(Cell *cell, double rot) {
+    if (cell->organelles_set) return;
+    locate_organelles(cell->genome, cell->e, rot, cell->org_x, cell->org_y, cell->org_r);
+    cell->organelles_set = 1;
+}
+void create_organelle_locs(Cell *cell, Pool *pool) {
+    int num_organelles = cell->genome->num_organelles;
+    cell->org_x = pool_alloc(pool, num_organelles * 3 * sizeof(*cell->org_x));
+    cell->org_y = cell->org_x + num_organelles;
+    cell->org_r = cell->org_y + num_organelles;
     cell->organelles_set = 0;
-    cell->drawn = 0;
-    cell->pause_motion = 0;
 }
 
-void save_cell(FILE *fp, Cell *cell) {
-    int i;
-    fprintf(fp, "%d %d %d %d %lf %lf %lf %lf %d %d %ld %d %d %d %d\n",
-            cell->x, cell->y, cell->x_err, cell->y_err,
-            cell->x_vel, cell->y_vel, cell->rot, cell->rot_vel,
+void save_cell(FILE *fp, Cell *cell, Kinematics *kin, int cell_id) {
+    fprintf(fp, "%d %d %d %d %lf %lf %lf %lf ",
+            kin->x[cell_id], kin->y[cell_id], kin->x_err[cell_id], kin->y_err[cell_id],
+            kin->x_vel[cell_id], kin->y_vel[cell_id], kin->rot[cell_id], kin->rot_vel[cell_id]);
+    fprintf(fp, "%d %d %ld %d %d %d %d\n",
             cell->mov_counter, cell->rot_counter, cell->e,
             cell->age, cell->state, cell->state_counter,
-            cell->num_organelles);
-    for (i = 0; i < cell->num_organelles; i++) {
-        fprintf(fp, "%lf %d %d %d\n",
-                cell->organelles[i].angle,
-                cell->organelles[i].r,
-                cell->organelles[i].type,
-                cell->organelles[i].parent_id);
-    }
+            cell->genome->num_organelles);
+    save_genome(fp, cell->genome);
 }
 
-void load_cell(FILE *fp, Cell *cell) {
-    int i;
+void load_cell(FILE *fp, Cell *cell, Kinematics *kin, int cell_id, Pool *pool) {
+    int x, y, x_err, y_err;
+    double x_vel, y_vel, rot, rot_vel;
+    int num_organelles;
     fscanf(fp, "%d %d %d %d %lf %lf %lf %lf %d %d %ld %d %d %d %d\n",
-            &cell->x, &cell->y, &cell->x_err, &cell->y_err,
-            &cell->x_vel, &cell->y_vel,
-            &cell->rot, &cell->rot_vel,
+            &x, &y, &x_err, &y_err,
+            &x_vel, &y_vel,
+            &rot, &rot_vel,
             &cell->mov_counter, &cell->rot_counter, &cell->e,
             &cell->age, &cell->state, &cell->state_counter,
-            &cell->num_organelles);
-    cell->organelles = malloc(cell->num_organelles * sizeof(Organelle));
-    for (i = 0; i < cell->num_organelles; i++) {
-        fscanf(fp, "%lf %d %d %d\n",
-                &cell->organelles[i].angle,
-                &cell->organelles[i].r,
-                &cell->organelles[i].type,
-                &cell->organelles[i].parent_id);
-    }
+            &num_organelles);
+    cell->genome = load_genome(fp, num_organelles, pool);
+    reset_kinematics(kin, cell_id, x, y, rot);
+    kin->x_err[cell_id] = x_err;
+    kin->y_err[cell_id] = y_err;
+    kin->x_vel[cell_id] = x_vel;
+    kin->y_vel[cell_id] = y_vel;
+    kin->rot_vel[cell_id] = rot_vel;
     cell->virus = NULL;
 }
 
-void free_cell(Cell *cell) {
-    int i;
-    for (i = 0; i < cell->num_organelles; i++) {
-        free(cell->organelles[i].children);
-    }
-    free(cell->organelles);
-    if (cell->virus) {
-        free_cell(cell->virus);
-        free(cell->virus);
-    }
-}
-
-SDL_Color get_type_color(int type) {
-    switch (type) {
-        case 0:
-            return (SDL_Color){0, 255, 0};
-        case 1:
-            return (SDL_Color){255, 0, 255};
-        case 2:
-            return (SDL_Color){255, 91, 0};
-        case 3:
-            return (SDL_Color){0, 255, 255};
-        case 4:
-            return (SDL_Color){255, 0, 0};
-        case 5:
-            return (SDL_Color){0, 0, 255};
-        case 6:
-            return (SDL_Color){255, 255, 0};
-        case 7:
-            return (SDL_Color){255, 255, 255};
-        case 8:
-            return (SDL_Color){127, 127, 127};
-        case 9:
-            return (SDL_Color){127, 0, 192};
-    }
-    return (SDL_Color){0, 0, 0};
+void save_virus(FILE *fp, Genome *virus) {
+    fprintf(fp, "0 0 0 0 %lf %lf %lf %lf ", 0.0, 0.0, 0.0, 0.0);
+    fprintf(fp, "0 0 0 0 0 0 %d\n", virus->num_organelles);
+    save_genome(fp, virus);
 }
 
-Uint32 map_type_color(int type, SDL_PixelFormat *format) {
-    switch (type) {
-        case 0:
-            return SDL_MapRGB(format, 0, 255, 0);
-        case 1:
-            return SDL_MapRGB(format, 255, 0, 255);
-        case 2:
-            return SDL_MapRGB(format, 255, 91, 0);
-        case 3:
-            return SDL_MapRGB(format, 0, 255, 255);
-        case 4:
-            return SDL_MapRGB(format, 255, 0, 0);
-        case 5:
-            return SDL_MapRGB(format, 0, 0, 255);
-        case 6:
-            return SDL_MapRGB(format, 255, 255, 0);
-        case 7:
-            return SDL_MapRGB(format, 255, 255, 255);
-        case 8:
-            return SDL_MapRGB(format, 127, 127, 127);
-        case 9:
-            return SDL_MapRGB(format, 127, 0, 192);
-    }
-    return 0;
+Genome *load_virus(FILE *fp, Pool *pool) {
+    int skipped_int;
+    long skipped_long;
+    double skipped_double;
+    int num_organelles;
+    fscanf(fp, "%d %d %d %d %lf %lf %lf %lf %d %d %ld %d %d %d %d\n",
+            &skipped_int, &skipped_int, &skipped_int, &skipped_int,
+            &skipped_double, &skipped_double,
+            &skipped_double, &skipped_double,
+            &skipped_int, &skipped_int, &skipped_long,
+            &skipped_int, &skipped_int, &skipped_int,
+            &num_organelles);
+    return load_genome(fp, num_organelles, pool);
 }
 
-Uint32 map_state_color(int state, SDL_PixelFormat *format) {
-    switch (state) {
-        case 0:
-            return 0;
-        case 1:
-            return SDL_MapRGB(format, 127, 91, 0);
-        case 2:
-            return SDL_MapRGB(format, 91, 0, 16);
-        case 3:
-            return SDL_MapRGB(format, 0, 127, 0);
-        case 4:
-            return SDL_MapRGB(format, 255, 0, 0);
-        case 5:
-            return SDL_MapRGB(format, 0, 0, 255);
-        case 6:
-            return SDL_MapRGB(format, 255, 255, 0);
-        case 7:
-            return SDL_MapRGB(format, 255, 255, 255);
-        case 8:
-            return SDL_MapRGB(format, 127, 127, 127);
-        case 9:
-            return SDL_MapRGB(format, 127, 0, 192);
-        case 10:
-            return SDL_MapRGB(format, 255, 255, 128);
-    }
-    return 0;
+void free_cell(Cell *cell, Pool *pool) {
+    release_genome(cell->genome, pool);
+    release_genome(cell->virus, pool);
+    pool_free(pool, cell->org_x);
 }
 
 int energy_scale(int r, long e) {
@@ -272,86 +163,106 @@ int energy_scale(int r, long e) {
     return (long)r * (capped_e + 500000) / 1500000;
 }
 
-void adjust_cells(Cell cells[MAX_CELLS], int num_cells, Cell **cells_in_regions[][Y_REGIONS], int num_cells_in_regions[][Y_REGIONS],
-        unsigned long long substances[3], int elapsed) {
+// cells whose impulses are drawn together
+#define PUSH_BATCH 64
+
+// gives the cells in ids their movement organelles' next push or turn, whichever is due
+static void push_batch(Cell *cells, Kinematics *kin, const int *ids, int n, unsigned long long seed,
+        unsigned long step) {
+    int k;
+    unsigned long long keys[PUSH_BATCH];
+    int push[4 * PUSH_BATCH];
+    int timing[4 * PUSH_BATCH];
+    for (k = 0; k < n; k++) {
+        keys[k] = cells[ids[k]].id;
+    }
+    fill_random_blocks(seed, RANDOM_PUSH, step, keys, n, push);
+    fill_random_blocks(seed, RANDOM_TIMING, step, keys, n, timing);
+    for (k = 0; k < n; k++) {
+        int i = ids[k];
+        if (cells[i].mov_counter <= 0) {
+            kin->x_vel[i] += cos(M_PI * (push[4*k] % 256) / 128) * cells[i].genome->type_counts[3] * (push[4*k + 1] % (CELL_SPEED / 2) + CELL_SPEED) / cells[i].genome->weight;
+            kin->y_vel[i] += sin(M_PI * (push[4*k + 2] % 256) / 128) * cells[i].genome->type_counts[3] * (push[4*k + 3] % (CELL_SPEED / 2) + CELL_SPEED) / cells[i].genome->weight;
+            cells[i].mov_counter = CELL_MOV_DELAY_MAX - timing[4*k] % (CELL_MOV_DELAY_MAX - CELL_MOV_DELAY_MIN);
+        }
+        if (cells[i].rot_counter <= 0) {
+            kin->rot_vel[i] += (timing[4*k + 1] % CELL_ROT_SPEED - CELL_ROT_SPEED / 2) * M_PI * cells[i].genome->type_counts[3] / cells[i].genome->weight / 3;
+            cells[i].rot_counter = CELL_ROT_DELAY_MAX - timing[4*k + 2] % (CELL_ROT_DELAY_MAX - CELL_ROT_DELAY_MIN);
+        }
+    }
+}
 
-    int i, j, k, l;
-    for (i = 0; i < num_cells; i++) {
+// gives cells start to end - 1 random pushes from their movement organelles
+static void push_cells(Cell *cells, Kinematics *kin, int start, int end, int elapsed,
+        unsigned long long seed, unsigned long step) {
+    int i;
+    int ids[PUSH_BATCH];
+    int n = 0;
+    for (i = start; i < end; i++) {
         // activate movement organelles
+        int due = 0;
         if (cells[i].mov_counter > 0) {
             cells[i].mov_counter -= elapsed;
         } else {
-            cells[i].x_vel += cos(M_PI * (rand() % 256) / 128) * cells[i].type_counts[3] * (rand() % (CELL_SPEED / 2) + CELL_SPEED) / cells[i].weight;
-            cells[i].y_vel += sin(M_PI * (rand() % 256) / 128) * cells[i].type_counts[3] * (rand() % (CELL_SPEED / 2) + CELL_SPEED) / cells[i].weight;
-            cells[i].mov_counter = CELL_MOV_DELAY_MAX - rand() % (CELL_MOV_DELAY_MAX - CELL_MOV_DELAY_MIN);
+            due = 1;
         }
         if (cells[i].rot_counter > 0) {
             cells[i].rot_counter -= elapsed;
         } else {
-            cells[i].rot_vel += (rand() % CELL_ROT_SPEED - CELL_ROT_SPEED / 2) * M_PI * cells[i].type_counts[3] / cells[i].weight / 3;
-            cells[i].rot_counter = CELL_ROT_DELAY_MAX - rand() % (CELL_ROT_DELAY_MAX - CELL_ROT_DELAY_MIN);
+            due = 1;
         }
-
-        // apply movement friction
-        double total_friction = pow(FRICTION, elapsed);
-        double last_x_vel = cells[i].x_vel;
-        cells[i].x_vel *= total_friction;
-        int dx = (total_friction - 1) * last_x_vel / LN_FRICTION;
-        double last_y_vel = cells[i].y_vel;
-        cells[i].y_vel *= total_friction;
-        int dy = (total_friction - 1) * last_y_vel / LN_FRICTION;
-
-        if (!cells[i].pause_motion) {
-            // move cell
-            cells[i].x_err += dx;
-            cells[i].x += cells[i].x_err / 1000;
-            cells[i].x_err -= cells[i].x_err / 1000 * 1000;
-            cells[i].y_err += dy;
-            cells[i].y += cells[i].y_err / 1000;
-            cells[i].y_err -= cells[i].y_err / 1000 * 1000;
-
-            // apply rotational friction
-            double last_rot_vel = cells[i].rot_vel;
-            cells[i].rot_vel *= total_friction;
-            double drot = (total_friction - 1) * last_rot_vel / LN_FRICTION;
-
-            // rotate cell
-            cells[i].rot += drot / 1000;
-            if (cells[i].rot < 0) {
-                cells[i].rot += M_PI * 2;
-            } else if (cells[i].rot >= M_PI * 2) {
-                cells[i].rot -= M_PI * 2;
+        if (due) {
+            ids[n++] = i;
+            if (n == PUSH_BATCH) {
+                push_batch(cells, kin, ids, n, seed, step);
+                n = 0;
             }
         }
     }
+    push_batch(cells, kin, ids, n, seed, step);
+}
 
-    for (i = 0; i < X_REGIONS; i++) {
-        for (j = 0; j < Y_REGIONS; j++) {
-            for (k = 0; k < num_cells_in_regions[i][j]; k++) {
-                for (l = k + 1; l < num_cells_in_regions[i][j]; l++) {
-                    handle_cell_collisions(cells_in_regions[i][j][k], cells_in_regions[i][j][l]);
-                }
-            }
+// what a cell that isn't interacting would synthesize from substance j, if it had it to itself
+static int synthesis_wanted(const Cell *cell, int j, const unsigned long long substances[3], int elapsed) {
+    unsigned long long synthesis = cell->genome->type_counts[j] * elapsed * SYNTHESIS_FACTOR / SYNTHESIS_DIVISOR +
+        cell->genome->type_counts[j] * substances[j] / SYNTHESIS_SUBSTANCE_DIVISOR * elapsed;
+    if (synthesis > substances[j]) {
+        synthesis = substances[j];
+    }
+    return synthesis;
+}
+
+// adds up what cells start to end - 1 want to synthesize from each substance
+static void count_synthesis(const Cell *cells, int start, int end, const unsigned long long substances[3],
+        unsigned long long demand[3], int elapsed) {
+    int i, j;
+    for (i = start; i < end; i++) {
+        if (cells[i].state_counter) continue;
+        for (j = 0; j < 3; j++) {
+            demand[j] += synthesis_wanted(cells + i, j, substances, elapsed);
         }
     }
+}
 
+// one of the three substances, drawn from the cell's stream. a cell draws at most once a step
+static int random_substance(const Cell *cell, unsigned long long seed, unsigned long step) {
+    RandomStream random;
+    start_random_stream(&random, seed, RANDOM_METABOLISM, step, cell->id, 0);
+    return next_random(&random) % 3;
+}
 
-    for (i = 0; i < X_REGIONS; i++) {
-        for (j = 0; j < Y_REGIONS; j += Y_REGIONS - 1) {
-            for (k = 0; k < num_cells_in_regions[i][j]; k++) {
-                handle_wall_collisions(cells_in_regions[i][j][k]);
-            }
-        }
-    }
-    for (i = 0; i < X_REGIONS; i += X_REGIONS - 1) {
-        for (j = 0; j < Y_REGIONS; j++) {
-            for (k = 0; k < num_cells_in_regions[i][j]; k++) {
-                handle_wall_collisions(cells_in_regions[i][j][k]);
-            }
-        }
+// applies the energy changes of cells start to end - 1. every cell sees the substances as they were
+// at the start of the phase, and what it takes or gives back is added to change. where all the cells
+// together want more of a substance than there is, each gets its share of what there is
+static void metabolize_cells(Cell *cells, int start, int end, int num_cells,
+        const unsigned long long substances[3], const unsigned long long demand[3], long long change[3],
+        int elapsed, unsigned long long seed, unsigned long step) {
+    int i, j;
+    unsigned long long substance_total = 0;
+    for (j = 0; j < 3; j++) {
+        substance_total += substances[j];
     }
-
-    for (i = 0; i < num_cells; i++) {
+    for (i = start; i < end; i++) {
         // apply energy changes
         if (cells[i].state_counter) {
             int state_elapsed;
@@ -365,15 +276,15 @@ void adjust_cells(Cell cells[MAX_CELLS], int num_cells, Cell **cells_in_regions[
                     break;
                 case 1:
                     cells[i].e -= EAT_LOSS_RATE * state_elapsed;
-                    substances[2] += (EAT_LOSS_RATE - EAT_GAIN_RATE) * state_elapsed;
+                    change[2] += (EAT_LOSS_RATE - EAT_GAIN_RATE) * state_elapsed;
                     break;
                 case 2:
                     cells[i].e -= EAT_LOSS_RATE * state_elapsed;
-                    substances[1] += (EAT_LOSS_RATE - EAT_GAIN_RATE) * state_elapsed;
+                    change[1] += (EAT_LOSS_RATE - EAT_GAIN_RATE) * state_elapsed;
                     break;
                 case 3:
                     cells[i].e -= EAT_LOSS_RATE * state_elapsed;
-                    substances[0] += (EAT_LOSS_RATE - EAT_GAIN_RATE) * state_elapsed;
+                    change[0] += (EAT_LOSS_RATE - EAT_GAIN_RATE) * state_elapsed;
                     break;
                 case 4:
                 case 5:
@@ -391,7 +302,7 @@ void adjust_cells(Cell cells[MAX_CELLS], int num_cells, Cell **cells_in_regions[
                     break;
                 case 10:
                     cells[i].e -= ANTIVIRUS_LOSS_RATE * state_elapsed;
-                    substances[rand()%3] += (ANTIVIRUS_LOSS_RATE - ANTIVIRUS_GAIN_RATE) * state_elapsed;
+                    change[random_substance(cells + i, seed, step)] += (ANTIVIRUS_LOSS_RATE - ANTIVIRUS_GAIN_RATE) * state_elapsed;
                     break;
             }
             cells[i].state_counter -= state_elapsed;
@@ -401,19 +312,20 @@ void adjust_cells(Cell cells[MAX_CELLS], int num_cells, Cell **cells_in_regions[
         } else {
             // regular energy changes only when not interacting
             for (j = 0; j < 3; j++) {
-                int synthesis = cells[i].type_counts[j] * elapsed * SYNTHESIS_FACTOR / SYNTHESIS_DIVISOR +
-                    cells[i].type_counts[j] * substances[j] / SYNTHESIS_SUBSTANCE_DIVISOR * elapsed;
-                if (synthesis > substances[j]) {
-                    synthesis = substances[j];
+                int synthesis = synthesis_wanted(cells + i, j, substances, elapsed);
+                if (demand[j] > substances[j]) {
+                    // rounded down, so the shares never add up to more than there is. synthesis is
+                    // below 2^31 and the substances below 2^33, so the product fits
+                    synthesis = synthesis * substances[j] / demand[j];
                 }
-                substances[j] -= synthesis;
+                change[j] -= synthesis;
                 int out_flow = synthesis / 7;
-                substances[(j + 1) % 3] += out_flow;
+                change[(j + 1) % 3] += out_flow;
                 cells[i].e += synthesis - out_flow;
             }
 
-            long energy_loss = cells[i].weight * cells[i].weight * num_cells * elapsed / 49000 +
-                cells[i].weight * num_cells * elapsed / 2000 +
+            long energy_loss = cells[i].genome->weight * cells[i].genome->weight * num_cells * elapsed / 49000 +
+                cells[i].genome->weight * num_cells * elapsed / 2000 +
                 num_cells * elapsed / 35;
             cells[i].age += elapsed;
             if (cells[i].age > CELL_MAX_AGE) {
@@ -424,79 +336,272 @@ void adjust_cells(Cell cells[MAX_CELLS], int num_cells, Cell **cells_in_regions[
             } else {
             	energy_loss = 0;
             }
-            unsigned long long substance_total = 0;
-            for (j = 0; j < 3; j++) {
-                substance_total += substances[j];
-            }
             long substance_added = 0;
             for (j = 0; j < 3; j++) {
                 substance_added += energy_loss * substances[j] / substance_total;
-                substances[j] += energy_loss * substances[j] / substance_total;
+                change[j] += energy_loss * substances[j] / substance_total;
             }
-            if (energy_loss > substance_added) substances[rand()%3] += energy_loss - substance_added;
+            if (energy_loss > substance_added) change[random_substance(cells + i, seed, step)] += energy_loss - substance_added;
 
         }
         cells[i].organelles_set = 0;
-        cells[i].drawn = 0;
     }
 }
 
-void handle_cell_collisions(Cell *a_cell, Cell *b_cell) {
+// everything a chunk of adjust_cells needs. each chunk adds up its own changes to the substances
+typedef struct AdjustJob {
+    Cell *cells;
+    Kinematics *kin;
+    int num_cells;
+    SpatialHash *hash;
+    Collisions *collisions;
+    int elapsed;
+    unsigned long long seed;
+    unsigned long step;
+    unsigned long long *substances;
+    unsigned long long demands[MAX_WORKERS][3]; // of each chunk, then the total in demands[0]
+    long long changes[MAX_WORKERS][3];
+    int found[MAX_WORKERS]; // 0 if a chunk's contact list couldn't grow and some contacts are missing
+} AdjustJob;
+
+static void move_chunk(void *data, int chunk, int num_chunks) {
+    AdjustJob *job = data;
+    int start = chunk_start(job->num_cells, chunk, num_chunks);
+    int end = chunk_start(job->num_cells, chunk + 1, num_chunks);
+    push_cells(job->cells, job->kin, start, end, job->elapsed, job->seed, job->step);
+    integrate_kinematics(job->kin, start, end, job->elapsed);
+}
+
+// finds the contacts of an even share of the pairs, which are sorted so that acting on the chunks
+// in turn goes through the pairs in the same order whatever the number of threads
+static void contact_chunk(void *data, int chunk, int num_chunks) {
+    AdjustJob *job = data;
+    SpatialHash *hash = job->hash;
+    Collisions *collisions = job->collisions;
+    ContactList *list = collisions->lists + chunk;
+    int p;
+    list->num_contacts = 0;
+    job->found[chunk] = 1;
+    for (p = chunk_start(hash->num_pairs, chunk, num_chunks); p < chunk_start(hash->num_pairs, chunk + 1, num_chunks); p++) {
+        collisions->firsts[p] = list->num_contacts;
+        job->found[chunk] &= find_contacts(job->cells, job->kin, hash->pairs[p].a, hash->pairs[p].b, list);
+        collisions->counts[p] = list->num_contacts - collisions->firsts[p];
+    }
+}
+
+static void wall_chunk(void *data, int chunk, int num_chunks) {
+    AdjustJob *job = data;
+    int i;
+    for (i = chunk_start(job->num_cells, chunk, num_chunks); i < chunk_start(job->num_cells, chunk + 1, num_chunks); i++) {
+        handle_wall_collisions(job->cells + i, job->kin, i, job->hash->width, job->hash->height);
+    }
+}
+
+static void demand_chunk(void *data, int chunk, int num_chunks) {
+    AdjustJob *job = data;
+    int j;
+    for (j = 0; j < 3; j++) {
+        job->demands[chunk][j] = 0;
+    }
+    count_synthesis(job->cells, chunk_start(job->num_cells, chunk, num_chunks),
+            chunk_start(job->num_cells, chunk + 1, num_chunks), job->substances, job->demands[chunk], job->elapsed);
+}
+
+static void energy_chunk(void *data, int chunk, int num_chunks) {
+    AdjustJob *job = data;
+    int j;
+    for (j = 0; j < 3; j++) {
+        job->changes[chunk][j] = 0;
+    }
+    metabolize_cells(job->cells, chunk_start(job->num_cells, chunk, num_chunks),
+            chunk_start(job->num_cells, chunk + 1, num_chunks), job->num_cells, job->substances, job->demands[0],
+            job->changes[chunk], job->elapsed, job->seed, job->step);
+}
+
+int adjust_cells(Cell *cells, Kinematics *kin, int num_cells, SpatialHash *hash, Broadphase *broadphase,
+        const HandleTable *handles, Collisions *collisions, Workers *workers,
+        unsigned long long substances[3], int elapsed, unsigned long long seed, unsigned long step) {
     int i, j;
-    int dx = a_cell->x - b_cell->x;
-    int dy = a_cell->y - b_cell->y;
-    int rs = energy_scale(a_cell->r, a_cell->e) + energy_scale(b_cell->r, b_cell->e);
-    if (dx * dx + dy * dy < rs * rs) {
-        if (!a_cell->organelles_set) {
-            set_organelle_loc(a_cell->organelles, 0, 0, energy_scale(-a_cell->organelles->r, a_cell->e), a_cell->rot, a_cell->e);
-            a_cell->organelles_set = 1;
+    AdjustJob job;
+    job.cells = cells;
+    job.kin = kin;
+    job.num_cells = num_cells;
+    job.hash = hash;
+    job.collisions = collisions;
+    job.elapsed = elapsed;
+    job.seed = seed;
+    job.step = step;
+    job.substances = substances;
+
+    PROFILE_BEGIN(PHASE_INTEGRATION);
+    run_workers(workers, move_chunk, &job);
+    PROFILE_END(PHASE_INTEGRATION);
+
+    PROFILE_BEGIN(PHASE_PAIRS);
+    int complete = find_broadphase_pairs(broadphase, hash, cells, kin, num_cells, handles);
+    PROFILE_END(PHASE_PAIRS);
+
+    PROFILE_BEGIN(PHASE_COLLISIONS);
+    if (hash->num_pairs > collisions->pairs_allocated) {
+        int *firsts = realloc(collisions->firsts, sizeof(*collisions->firsts) * hash->pairs_allocated);
+        if (firsts) collisions->firsts = firsts;
+        int *counts = realloc(collisions->counts, sizeof(*collisions->counts) * hash->pairs_allocated);
+        if (counts) collisions->counts = counts;
+        if (firsts && counts) {
+            collisions->pairs_allocated = hash->pairs_allocated;
+        } else {
+            // finish the step with the pairs there is room for, but say that some were left out
+            hash->num_pairs = collisions->pairs_allocated;
+            complete = 0;
         }
-        if (!b_cell->organelles_set) {
-            set_organelle_loc(b_cell->organelles, 0, 0, energy_scale(-b_cell->organelles->r, b_cell->e), b_cell->rot, b_cell->e);
-            b_cell->organelles_set = 1;
+    }
+    // only the pairs' contacts are found in parallel; what they do to the cells depends
+    // on what earlier pairs did, so that happens here in order
+    for (i = 0; i < hash->num_pairs; i++) {
+        set_organelle_locs(cells + hash->pairs[i].a, kin->rot[hash->pairs[i].a]);
+        set_organelle_locs(cells + hash->pairs[i].b, kin->rot[hash->pairs[i].b]);
+    }
+    run_workers(workers, contact_chunk, &job);
+    for (j = 0; j < workers->num_threads; j++) {
+        complete &= job.found[j];
+    }
+    for (j = 0; j < workers->num_threads; j++) {
+        for (i = chunk_start(hash->num_pairs, j, workers->num_threads); i < chunk_start(hash->num_pairs, j + 1, workers->num_threads); i++) {
+            if (collisions->counts[i]) {
+                RandomStream random;
+                unsigned long long a_id = cells[hash->pairs[i].a].id;
+                unsigned long long b_id = cells[hash->pairs[i].b].id;
+                // the same stream whichever way round the pair is stored
+                start_random_stream(&random, seed, RANDOM_COLLISION, step, a_id < b_id ? a_id : b_id, a_id < b_id ? b_id : a_id);
+                handle_cell_collisions(cells, kin, hash->pairs[i].a, hash->pairs[i].b,
+                        collisions->lists[j].contacts + collisions->firsts[i], collisions->counts[i], &random);
+            }
+        }
+    }
+    PROFILE_END(PHASE_COLLISIONS);
+
+    PROFILE_BEGIN(PHASE_WALLS);
+    run_workers(workers, wall_chunk, &job);
+    PROFILE_END(PHASE_WALLS);
+
+    PROFILE_BEGIN(PHASE_ENERGY);
+    // what the cells want of each substance first, so that they can share out a nearly spent one
+    run_workers(workers, demand_chunk, &job);
+    for (j = 0; j < 3; j++) {
+        for (i = 1; i < workers->num_threads; i++) {
+            job.demands[0][j] += job.demands[i][j];
+        }
+    }
+    run_workers(workers, energy_chunk, &job);
+    for (j = 0; j < 3; j++) {
+        long long change = 0;
+        for (i = 0; i < workers->num_threads; i++) {
+            change += job.changes[i][j];
         }
-        int a_collision_min_dist2 = rs * rs;
-        int b_collision_min_dist2 = rs * rs;
-        for (i = 0; i < a_cell->num_organelles; i++) {
-            for (j = 0; j < b_cell->num_organelles; j++) {
-                dx = (a_cell->organelles[i].x + a_cell->x) - (b_cell->organelles[j].x + b_cell->x);
-                dy = (a_cell->organelles[i].y + a_cell->y) - (b_cell->organelles[j].y + b_cell->y);
-                rs = energy_scale(a_cell->organelles[i].r, a_cell->e) + energy_scale(b_cell->organelles[j].r, b_cell->e);
-                if (dx * dx + dy * dy < rs * rs) {
-                    if (!(a_cell->state || b_cell->state)) {
-                        handle_organelle_interaction(a_cell, b_cell, a_cell->organelles[i].type, b_cell->organelles[j].type);
-                        handle_organelle_interaction(b_cell, a_cell, b_cell->organelles[j].type, a_cell->organelles[i].type);
-                    }
-                    int a_cur_dist2 = a_cell->organelles[i].x * a_cell->organelles[i].x +
-                        a_cell->organelles[i].y * a_cell->organelles[i].y;
-                    if (a_cur_dist2 < a_collision_min_dist2) {
-                        a_collision_min_dist2 = a_cur_dist2;
-                        a_cell->x_vel = dx * CELL_HARDNESS;
-                        a_cell->y_vel = dy * CELL_HARDNESS;
-                        a_cell->rot_vel = -atan2(dy, dx) * CELL_HARDNESS / 6;
-                    }
-                    int b_cur_dist2 = b_cell->organelles[j].x * b_cell->organelles[j].x +
-                        b_cell->organelles[j].y * b_cell->organelles[j].y;
-                    if (b_cur_dist2 < b_collision_min_dist2) {
-                        b_collision_min_dist2 = b_cur_dist2; 
-                        b_cell->x_vel = -dx * CELL_HARDNESS;
-                        b_cell->y_vel = -dy * CELL_HARDNESS;
-                        b_cell->rot_vel = atan2(dy, dx) * CELL_HARDNESS / 6;
-                    }
-                    if (!(dx || dy)) {
-                        a_cell->x_vel = rand() % 3 - 1;
-                        a_cell->y_vel = rand() % 3 - 1;
-                        b_cell->x_vel = rand() % 3 - 1;
-                        b_cell->y_vel = rand() % 3 - 1;
-                    }
+        // nothing takes more than its share, so this never goes below zero
+        substances[j] += change;
+    }
+    PROFILE_END(PHASE_ENERGY);
+    return complete;
+}
+
+int create_collisions(Collisions *collisions, int capacity) {
+    int i;
+    for (i = 0; i < MAX_WORKERS; i++) {
+        collisions->lists[i].contacts = NULL;
+        collisions->lists[i].num_contacts = 0;
+        collisions->lists[i].contacts_allocated = 0;
+    }
+    collisions->pairs_allocated = capacity * 2;
+    collisions->firsts = malloc(sizeof(*collisions->firsts) * collisions->pairs_allocated);
+    collisions->counts = malloc(sizeof(*collisions->counts) * collisions->pairs_allocated);
+    if (!(collisions->firsts && collisions->counts)) {
+        free_collisions(collisions);
+        return 0;
+    }
+    return 1;
+}
+
+void free_collisions(Collisions *collisions) {
+    int i;
+    for (i = 0; i < MAX_WORKERS; i++) {
+        free(collisions->lists[i].contacts);
+    }
+    free(collisions->firsts);
+    free(collisions->counts);
+}
+
+int find_contacts(Cell *cells, Kinematics *kin, int a, int b, ContactList *list) {
+    int i, j;
+    Cell *a_cell = cells + a;
+    Cell *b_cell = cells + b;
+    for (i = 0; i < a_cell->genome->num_organelles; i++) {
+        for (j = 0; j < b_cell->genome->num_organelles; j++) {
+            int dx = (a_cell->org_x[i] + kin->x[a]) - (b_cell->org_x[j] + kin->x[b]);
+            int dy = (a_cell->org_y[i] + kin->y[a]) - (b_cell->org_y[j] + kin->y[b]);
+            int rs = a_cell->org_r[i] + b_cell->org_r[j];
+            if (dx * dx + dy * dy < rs * rs) {
+                if (list->num_contacts == list->contacts_allocated) {
+                    int allocated = list->contacts_allocated ? list->contacts_allocated * 2 : 256;
+                    Contact *contacts = realloc(list->contacts, sizeof(*list->contacts) * allocated);
+                    if (contacts == NULL) return 0;
+                    list->contacts = contacts;
+                    list->contacts_allocated = allocated;
                 }
+                Contact *contact = list->contacts + list->num_contacts++;
+                contact->i = i;
+                contact->j = j;
+                contact->dx = dx;
+                contact->dy = dy;
             }
         }
     }
+    return 1;
 }
 
-void handle_organelle_interaction(Cell *a_cell, Cell *b_cell, int a_type, int b_type) {
-    int i;
+void handle_cell_collisions(Cell *cells, Kinematics *kin, int a, int b, Contact *contacts, int num_contacts,
+        RandomStream *random) {
+    int k;
+    Cell *a_cell = cells + a;
+    Cell *b_cell = cells + b;
+    int rs = energy_scale(a_cell->genome->r, a_cell->e) + energy_scale(b_cell->genome->r, b_cell->e);
+    int a_collision_min_dist2 = rs * rs;
+    int b_collision_min_dist2 = rs * rs;
+    for (k = 0; k < num_contacts; k++) {
+        int i = contacts[k].i;
+        int j = contacts[k].j;
+        int dx = contacts[k].dx;
+        int dy = contacts[k].dy;
+        if (!(a_cell->state || b_cell->state)) {
+            handle_organelle_interaction(a_cell, b_cell, a_cell->genome->organelles[i].type, b_cell->genome->organelles[j].type,
+                    random);
+            handle_organelle_interaction(b_cell, a_cell, b_cell->genome->organelles[j].type, a_cell->genome->organelles[i].type,
+                    random);
+        }
+        int a_cur_dist2 = a_cell->org_x[i] * a_cell->org_x[i] + a_cell->org_y[i] * a_cell->org_y[i];
+        if (a_cur_dist2 < a_collision_min_dist2) {
+            a_collision_min_dist2 = a_cur_dist2;
+            kin->x_vel[a] = dx * CELL_HARDNESS;
+            kin->y_vel[a] = dy * CELL_HARDNESS;
+            kin->rot_vel[a] = -atan2(dy, dx) * CELL_HARDNESS / 6;
+        }
+        int b_cur_dist2 = b_cell->org_x[j] * b_cell->org_x[j] + b_cell->org_y[j] * b_cell->org_y[j];
+        if (b_cur_dist2 < b_collision_min_dist2) {
+            b_collision_min_dist2 = b_cur_dist2; 
+            kin->x_vel[b] = -dx * CELL_HARDNESS;
+            kin->y_vel[b] = -dy * CELL_HARDNESS;
+            kin->rot_vel[b] = atan2(dy, dx) * CELL_HARDNESS / 6;
+        }
+        if (!(dx || dy)) {
+            kin->x_vel[a] = next_random(random) % 3 - 1;
+            kin->y_vel[a] = next_random(random) % 3 - 1;
+            kin->x_vel[b] = next_random(random) % 3 - 1;
+            kin->y_vel[b] = next_random(random) % 3 - 1;
+        }
+    }
+}
+
+void handle_organelle_interaction(Cell *a_cell, Cell *b_cell, int a_type, int b_type, RandomStream *random) {
     if (a_type == 4 && b_cell->e > 0 &&
             !(b_type == 4 || b_type == 5 || b_type == 7 || b_type == 8)) {
         a_cell->state = 4;
@@ -521,16 +626,7 @@ void handle_organelle_interaction(Cell *a_cell, Cell *b_cell, int a_type, int b_
         b_cell->state = 9;
         a_cell->state_counter = MAX_STATE_DURATION;
         b_cell->state_counter = MAX_STATE_DURATION;
-        b_cell->virus = malloc(sizeof(Cell));
-        *b_cell->virus = *a_cell;
-        b_cell->virus->organelles = malloc(b_cell->virus->num_organelles * sizeof(Organelle));
-        for (i = 0; i < b_cell->virus->num_organelles; i++) {
-            b_cell->virus->organelles[i] = a_cell->organelles[i];
-            b_cell->virus->organelles[i].num_children = 0;
-            b_cell->virus->organelles[i].children = NULL;
-        }
-        set_secondary_variables(b_cell->virus);
-        b_cell->virus->virus = NULL;
+        b_cell->virus = share_genome(a_cell->genome);
     } else if (a_type == 8 && b_cell->e > 0 &&
             (b_type == 7 || b_cell->virus)) {
         a_cell->state = 8;
@@ -539,17 +635,8 @@ void handle_organelle_interaction(Cell *a_cell, Cell *b_cell, int a_type, int b_
         b_cell->state_counter = MAX_STATE_DURATION;
     }
     if ((b_cell->state == 1 || b_cell->state == 2 || b_cell->state == 3) &&
-            b_cell->virus && !a_cell->virus && rand() % 2) {
-        a_cell->virus = malloc(sizeof(Cell));
-        *a_cell->virus = *b_cell->virus;
-        a_cell->virus->organelles = malloc(a_cell->virus->num_organelles * sizeof(Organelle));
-        for (i = 0; i < a_cell->virus->num_organelles; i++) {
-            a_cell->virus->organelles[i] = b_cell->virus->organelles[i];
-            a_cell->virus->organelles[i].num_children = 0;
-            a_cell->virus->organelles[i].children = NULL;
-        }
-        set_secondary_variables(a_cell->virus);
-        a_cell->virus->virus = NULL;
+            b_cell->virus && !a_cell->virus && next_random(random) % 2) {
+        a_cell->virus = share_genome(b_cell->virus);
     }
     if ((b_cell->state == 1 || b_cell->state == 2 || b_cell->state == 3) &&
             b_cell->state_counter * EAT_LOSS_RATE > b_cell->e) {
@@ -568,105 +655,123 @@ void handle_organelle_interaction(Cell *a_cell, Cell *b_cell, int a_type, int b_
     }
 }
 
-void handle_wall_collisions(Cell *cell) {
-    if (cell->x - energy_scale(cell->r, cell->e) < 0) {
-        if (!cell->organelles_set) {
-            set_organelle_loc(cell->organelles, 0, 0, energy_scale(-cell->organelles->r, cell->e), cell->rot, cell->e);
-            cell->organelles_set = 1;
-        }
+void handle_wall_collisions(Cell *cell, Kinematics *kin, int cell_id, int width, int height) {
+    if (kin->x[cell_id] - energy_scale(cell->genome->r, cell->e) < 0) {
+        set_organelle_locs(cell, kin->rot[cell_id]);
         int dir_r = 0;
         int i;
-        for (i = 0; i < cell->num_organelles; i++) {
-            if (-(cell->organelles[i].x - energy_scale(cell->organelles[i].r, cell->e)) > dir_r) {
-                dir_r = -(cell->organelles[i].x - energy_scale(cell->organelles[i].r, cell->e));
+        for (i = 0; i < cell->genome->num_organelles; i++) {
+            if (-(cell->org_x[i] - cell->org_r[i]) > dir_r) {
+                dir_r = -(cell->org_x[i] - cell->org_r[i]);
             }
         }
-        if (cell->x - dir_r < 0) {
-            cell->x_vel = 0;
-            cell->x_err = 0;
-            cell->x = dir_r;
-        }
-    } else if (cell->x + energy_scale(cell->r, cell->e) >= AREA_WIDTH) {
-        if (!cell->organelles_set) {
-            set_organelle_loc(cell->organelles, 0, 0, energy_scale(-cell->organelles->r, cell->e), cell->rot, cell->e);
-            cell->organelles_set = 1;
+        if (kin->x[cell_id] - dir_r < 0) {
+            kin->x_vel[cell_id] = 0;
+            kin->x_err[cell_id] = 0;
+            kin->x[cell_id] = dir_r;
         }
+    } else if (kin->x[cell_id] + energy_scale(cell->genome->r, cell->e) >= width) {
+        set_organelle_locs(cell, kin->rot[cell_id]);
         int dir_r = 0;
         int i;
-        for (i = 0; i < cell->num_organelles; i++) {
-            if (cell->organelles[i].x + energy_scale(cell->organelles[i].r, cell->e) > dir_r) {
-                dir_r = cell->organelles[i].x + energy_scale(cell->organelles[i].r, cell->e);
+        for (i = 0; i < cell->genome->num_organelles; i++) {
+            if (cell->org_x[i] + cell->org_r[i] > dir_r) {
+                dir_r = cell->org_x[i] + cell->org_r[i];
             }
         }
-        if (cell->x + dir_r >= AREA_WIDTH) {
-            cell->x_vel = 0;
-            cell->x_err = 0;
-            cell->x = AREA_WIDTH - dir_r - 1;
+        if (kin->x[cell_id] + dir_r >= width) {
+            kin->x_vel[cell_id] = 0;
+            kin->x_err[cell_id] = 0;
+            kin->x[cell_id] = width - dir_r - 1;
         }
     }
-    if (cell->y - energy_scale(cell->r, cell->e) < 0) {
-        if (!cell->organelles_set) {
-            set_organelle_loc(cell->organelles, 0, 0, energy_scale(-cell->organelles->r, cell->e), cell->rot, cell->e);
-            cell->organelles_set = 1;
-        }
+    if (kin->y[cell_id] - energy_scale(cell->genome->r, cell->e) < 0) {
+        set_organelle_locs(cell, kin->rot[cell_id]);
         int dir_r = 0;
         int i;
-        for (i = 0; i < cell->num_organelles; i++) {
-            if (-(cell->organelles[i].y - energy_scale(cell->organelles[i].r, cell->e)) > dir_r) {
-                dir_r = -(cell->organelles[i].y - energy_scale(cell->organelles[i].r, cell->e));
+        for (i = 0; i < cell->genome->num_organelles; i++) {
+            if (-(cell->org_y[i] - cell->org_r[i]) > dir_r) {
+                dir_r = -(cell->org_y[i] - cell->org_r[i]);
             }
         }
-        if (cell->y - dir_r < 0) {
-            cell->y_vel = 0;
-            cell->y_err = 0;
-            cell->y = dir_r;
-        }
-    } else if (cell->y + energy_scale(cell->r, cell->e) >= AREA_HEIGHT) {
-        if (!cell->organelles_set) {
-            set_organelle_loc(cell->organelles, 0, 0, energy_scale(-cell->organelles->r, cell->e), cell->rot, cell->e);
-            cell->organelles_set = 1;
+        if (kin->y[cell_id] - dir_r < 0) {
+            kin->y_vel[cell_id] = 0;
+            kin->y_err[cell_id] = 0;
+            kin->y[cell_id] = dir_r;
         }
+    } else if (kin->y[cell_id] + energy_scale(cell->genome->r, cell->e) >= height) {
+        set_organelle_locs(cell, kin->rot[cell_id]);
         int dir_r = 0;
         int i;
-        for (i = 0; i < cell->num_organelles; i++) {
-            if (cell->organelles[i].y + energy_scale(cell->organelles[i].r, cell->e) > dir_r) {
-                dir_r = cell->organelles[i].y + energy_scale(cell->organelles[i].r, cell->e);
+        for (i = 0; i < cell->genome->num_organelles; i++) {
+            if (cell->org_y[i] + cell->org_r[i] > dir_r) {
+                dir_r = cell->org_y[i] + cell->org_r[i];
             }
         }
-        if (cell->y + dir_r >= AREA_HEIGHT) {
-            cell->y_vel = 0;
-            cell->y_err = 0;
-            cell->y = AREA_HEIGHT - dir_r - 1;
+        if (kin->y[cell_id] + dir_r >= height) {
+            kin->y_vel[cell_id] = 0;
+            kin->y_err[cell_id] = 0;
+            kin->y[cell_id] = height - dir_r - 1;
         }
     }
 }
 
-void census_cells(Cell cells[MAX_CELLS], int *num_cells, Cell **selected_cell, unsigned long long substances[3], int *hud_update) {
+// directions of the six places a child can be spawned around its parent
+static const double spawn_cos[6] = {1, 0.5, -0.5, -1, -0.5, 0.5};
+static const double spawn_sin[6] = {0, 0.86602540378443865, 0.86602540378443865, 0, -0.86602540378443865, -0.86602540378443865};
+
+// whether a cell of radius r centred at (x, y) would overlap any existing cell
+static int space_occupied(Cell *cells, Kinematics *kin, SpatialHash *hash, int x, int y, int r) {
+    int i, j, k;
+    int left = spatial_col(hash, x - r - hash->max_r);
+    int top = spatial_row(hash, y - r - hash->max_r);
+    int right = spatial_col(hash, x + r + hash->max_r);
+    int bottom = spatial_row(hash, y + r + hash->max_r);
+    for (j = top; j <= bottom; j++) {
+        for (i = left; i <= right; i++) {
+            int b = j * hash->cols + i;
+            for (k = hash->starts[b]; k < hash->starts[b + 1]; k++) {
+                int id = hash->entries[k];
+                if (id < 0) continue;
+                int dx = x - kin->x[id];
+                int dy = y - kin->y[id];
+                int rs = r + cells[id].genome->r;
+                if (dx * dx + dy * dy < rs * rs) return 1;
+            }
+        }
+    }
+    // cells born this census aren't in the buckets and may be larger than any that are
+    for (k = 0; k < hash->num_added; k++) {
+        int id = hash->added[k];
+        int dx = x - kin->x[id];
+        int dy = y - kin->y[id];
+        int rs = r + cells[id].genome->r;
+        if (dx * dx + dy * dy < rs * rs) return 1;
+    }
+    return 0;
+}
+
+void census_cells(Cell *cells, Kinematics *kin, int *num_cells, int max_cells, SpatialHash *hash,
+        HandleTable *handles, Pool *pool, unsigned long long substances[3], unsigned long long seed,
+        unsigned long step) {
     int i, j;
     for (i = 0; i < *num_cells; i++) {
-        if (cells[i].e >= 1000000 && *num_cells < MAX_CELLS) {
+        RandomStream random;
+        if (cells[i].e >= 1000000 && *num_cells < max_cells) {
+            start_random_stream(&random, seed, RANDOM_BIRTH, step, cells[i].id, 0);
             int empty_x[6];
             int empty_y[6];
             // first look for an empty space
             int num_empty = 0;
-            double d;
-            for (d = 0; d < 2*M_PI; d+=M_PI/3) {
-                int space_x = cells[i].x + cos(d) * (2*cells[i].r + 1);
-                int space_y = cells[i].y + sin(d) * (2*cells[i].r + 1);
-                int space_occupied = 0;
-                if (space_x - cells[i].r < 0 || space_x + cells[i].r >= AREA_WIDTH ||
-                        space_y - cells[i].r < 0 || space_y + cells[i].r >= AREA_HEIGHT) {
-                    space_occupied = 1;
+            int k;
+            int r = cells[i].genome->r;
+            for (k = 0; k < 6; k++) {
+                int space_x = kin->x[i] + spawn_cos[k] * (2*r + 1);
+                int space_y = kin->y[i] + spawn_sin[k] * (2*r + 1);
+                if (space_x - r < 0 || space_x + r >= hash->width || space_y - r < 0 || space_y + r >= hash->height) {
+                    continue;
                 }
-                for (j = 0; j < *num_cells; j++) {
-                    int dx = space_x - cells[j].x;
-                    int dy = space_y - cells[j].y;
-                    int rs = cells[i].r + cells[j].r;
-                    if (dx * dx + dy * dy < rs * rs) {
-                        space_occupied = 1;
-                    }
-                }
-                if (!space_occupied) {
+                if (!space_occupied(cells, kin, hash, space_x, space_y, r)) {
                     empty_x[num_empty] = space_x;
                     empty_y[num_empty] = space_y;
                     num_empty++;
@@ -675,94 +780,76 @@ void census_cells(Cell cells[MAX_CELLS], int *num_cells, Cell **selected_cell, u
             // if space exists, spawn child
             if (num_empty) {
             	// pick a random space to spawn
-                int spawn_space = rand() % num_empty;
+                int spawn_space = next_random(&random) % num_empty;
                 int spawn_x = empty_x[spawn_space];
                 int spawn_y = empty_y[spawn_space];
                 int mutation = 0;
-                if (rand() % 101 < MUTATION_CHANCE) {
-                    mutation = rand() % 6 + 1;
+                if (next_random(&random) % 101 < MUTATION_CHANCE) {
+                    mutation = next_random(&random) % 6 + 1;
                 }
-                Cell *parent_cell = cells + i;
-                if (parent_cell->virus && rand() % 2) {
-                    parent_cell = parent_cell->virus;
+                Genome *parent_genome = cells[i].genome;
+                Genome *parent_virus = cells[i].virus;
+                if (parent_virus && next_random(&random) % 2) {
+                    // take after the virus instead, which has no virus of its own to pass on
+                    parent_genome = parent_virus;
+                    parent_virus = NULL;
                 }
                 Cell tmp_cell;
-                tmp_cell.x = spawn_x;
-                tmp_cell.y = spawn_y;
-                tmp_cell.x_err = 0;
-                tmp_cell.y_err = 0;
-                tmp_cell.x_vel = 0;
-                tmp_cell.y_vel = 0;
-                tmp_cell.rot = cells[i].rot;
-                tmp_cell.rot_vel = 0;
+                reset_kinematics(kin, *num_cells, spawn_x, spawn_y, kin->rot[i]);
                 tmp_cell.mov_counter = 0;
                 tmp_cell.rot_counter = 0;
-                tmp_cell.pause_motion = 0;
-                tmp_cell.drawn = 0;
                 tmp_cell.e = cells[i].e / 2;
                 cells[i].e -= tmp_cell.e;
                 tmp_cell.age = 0;
-                if (parent_cell->virus && rand() % 2) {
+                if (parent_virus && next_random(&random) % 2) {
                     // pass on virus
-                    tmp_cell.virus = malloc(sizeof(Cell));
-                    *tmp_cell.virus = *parent_cell->virus;
-                    tmp_cell.virus->organelles = malloc(tmp_cell.virus->num_organelles * sizeof(Organelle));
-                    for (j = 0; j < tmp_cell.virus->num_organelles; j++) {
-                        tmp_cell.virus->organelles[j] = parent_cell->virus->organelles[j];
-                        tmp_cell.virus->organelles[j].num_children = 0;
-                        tmp_cell.virus->organelles[j].children = NULL;
-                    }
-                    set_secondary_variables(tmp_cell.virus);
+                    tmp_cell.virus = share_genome(parent_virus);
                 } else {
                     tmp_cell.virus = NULL;
                 }
-                tmp_cell.num_organelles = parent_cell->num_organelles;
+                // only a mutated child needs a genome of its own
                 switch (mutation) {
                     case 0:
+                        tmp_cell.genome = share_genome(parent_genome);
+                        break;
                     case 1:
                     case 2:
                     case 3:
                     case 4:
                         // mutation doesn't change number of organelles
-                        tmp_cell.organelles = malloc(tmp_cell.num_organelles * sizeof(Organelle));
+                        tmp_cell.genome = copy_genome(parent_genome, parent_genome->num_organelles, pool);
                         break;
                     case 5:
                         // adding an organelle
-                        tmp_cell.organelles = malloc((tmp_cell.num_organelles + 1) * sizeof(Organelle));
+                        tmp_cell.genome = copy_genome(parent_genome, parent_genome->num_organelles + 1, pool);
                         break;
                     case 6:
                         // removing an organelle
-                        if (tmp_cell.num_organelles > 1) {
-                            tmp_cell.num_organelles--;
+                        if (parent_genome->num_organelles > 1) {
+                            tmp_cell.genome = copy_genome(parent_genome, parent_genome->num_organelles - 1, pool);
+                        } else {
+                            tmp_cell.genome = copy_genome(parent_genome, parent_genome->num_organelles, pool);
                         }
-                        tmp_cell.organelles = malloc(tmp_cell.num_organelles * sizeof(Organelle));
                         break;
                 }
-                for (j = 0; j < tmp_cell.num_organelles; j++) {
-                    tmp_cell.organelles[j] = parent_cell->organelles[j];
-                    tmp_cell.organelles[j].num_children = 0;
-                    tmp_cell.organelles[j].children = NULL;
-                }
+                Genome *genome = tmp_cell.genome;
                 tmp_cell.state = 0;
                 tmp_cell.state_counter = 0;
-                for (j = 0; j < NUM_TYPES; j++) {
-                    tmp_cell.type_counts[j] = 0; 
-                }
                 switch (mutation) {
                     case 1:
                         {
                             // mutate an organelle's radius
-                            Organelle *mut_organelle = tmp_cell.organelles + rand() % tmp_cell.num_organelles;
+                            Organelle *mut_organelle = genome->organelles + next_random(&random) % genome->num_organelles;
                             int new_r;
-                            if (mut_organelle == tmp_cell.organelles) {
-                                new_r = 7 + rand() % 3;
+                            if (mut_organelle == genome->organelles) {
+                                new_r = 7 + next_random(&random) % 3;
                                 while (new_r == mut_organelle->r) {
-                                    new_r = 7 + rand() % 3;
+                                    new_r = 7 + next_random(&random) % 3;
                                 }
                             } else {
-                                new_r = 4 + rand() % 4;
+                                new_r = 4 + next_random(&random) % 4;
                                 while (new_r == mut_organelle->r) {
-                                    new_r = 4 + rand() % 4;
+                                    new_r = 4 + next_random(&random) % 4;
                                 }
                             }
                             mut_organelle->r = new_r;
@@ -771,8 +858,8 @@ void census_cells(Cell cells[MAX_CELLS], int *num_cells, Cell **selected_cell, u
                     case 2:
                         {
                             // mutate an organelle's angle
-                            Organelle *mut_organelle = tmp_cell.organelles + rand() % tmp_cell.num_organelles;
-                            int new_angle = rand() % 60 * M_PI / 32;
+                            Organelle *mut_organelle = genome->organelles + next_random(&random) % genome->num_organelles;
+                            int new_angle = next_random(&random) % 60 * M_PI / 32;
                             if (new_angle >= mut_organelle->angle - M_PI / 16) {
                                 new_angle += M_PI / 8;
                             }
@@ -782,8 +869,8 @@ void census_cells(Cell cells[MAX_CELLS], int *num_cells, Cell **selected_cell, u
                     case 3:
                         {
                             // mutate an organelle's type
-                            Organelle *mut_organelle = tmp_cell.organelles + rand() % tmp_cell.num_organelles;
-                            int new_type = rand() % (NUM_TYPES - 1);
+                            Organelle *mut_organelle = genome->organelles + next_random(&random) % genome->num_organelles;
+                            int new_type = next_random(&random) % (NUM_TYPES - 1);
                             if (new_type >= mut_organelle->type) {
                                 new_type++;
                             }
@@ -796,21 +883,21 @@ void census_cells(Cell cells[MAX_CELLS], int *num_cells, Cell **selected_cell, u
                             int old_type;
                             int cell_has_old_type = 0;
                             while (!cell_has_old_type) {
-                                old_type = rand() % NUM_TYPES;
+                                old_type = next_random(&random) % NUM_TYPES;
                                 cell_has_old_type = 0;
-                                for (j = 0; j < tmp_cell.num_organelles; j++) {
-                                    if (tmp_cell.organelles[j].type == old_type) {
+                                for (j = 0; j < genome->num_organelles; j++) {
+                                    if (genome->organelles[j].type == old_type) {
                                         cell_has_old_type = 1;
                                     }
                                 }
                             }
-                            int new_type = rand() % (NUM_TYPES - 1);
+                            int new_type = next_random(&random) % (NUM_TYPES - 1);
                             if (new_type >= old_type) {
                                 new_type++;
                             }
-                            for (j = 0; j < tmp_cell.num_organelles; j++) {
-                                if (tmp_cell.organelles[j].type == old_type) {
-                                    tmp_cell.organelles[j].type = new_type;
+                            for (j = 0; j < genome->num_organelles; j++) {
+                                if (genome->organelles[j].type == old_type) {
+                                    genome->organelles[j].type = new_type;
                                 }
                             }
                         }
@@ -819,37 +906,40 @@ void census_cells(Cell cells[MAX_CELLS], int *num_cells, Cell **selected_cell, u
                         {
                             // add an organelle
                             Organelle tmp_organelle;
-                            tmp_organelle.r = 4 + rand() % 4;
-                            tmp_organelle.angle = M_PI * (rand() % 64) / 32;
-                            tmp_organelle.type = rand() % NUM_TYPES;
-                            tmp_organelle.parent_id = rand() % tmp_cell.num_organelles;
-                            tmp_organelle.x = 0;
-                            tmp_organelle.y = 0;
-                            tmp_organelle.children = NULL;
-                            tmp_organelle.num_children = 0;
-                            tmp_cell.organelles[tmp_cell.num_organelles] = tmp_organelle;
-                            tmp_cell.num_organelles++;
+                            tmp_organelle.r = 4 + next_random(&random) % 4;
+                            tmp_organelle.angle = M_PI * (next_random(&random) % 64) / 32;
+                            tmp_organelle.type = next_random(&random) % NUM_TYPES;
+                            tmp_organelle.parent_id = next_random(&random) % genome->num_organelles;
+                            genome->organelles[genome->num_organelles] = tmp_organelle;
+                            genome->num_organelles++;
                         }
                         break;
                 }
-                set_secondary_variables(&tmp_cell);
+                if (mutation) {
+                    set_genome_variables(genome);
+                }
+                create_organelle_locs(&tmp_cell, pool);
                 cells[*num_cells] = tmp_cell;
+                register_cell(cells + *num_cells, handles, *num_cells);
                 (*num_cells)++;
+                add_spatial_cell(hash, *num_cells - 1);
             }
         } else if (*num_cells < 10) {
+            start_random_stream(&random, seed, RANDOM_FEED, step, cells[i].id, 0);
             // give energy
-            int s = rand()%3;
+            int s = next_random(&random)%3;
             while (cells[i].e < 1000000) {
                 if (substances[s] > 1000000) {
                     substances[s] -= 1000000;
                     cells[i].e += 1000000;
                 } else {
-                    s = rand()%3;
+                    s = next_random(&random)%3;
                 }
             }
         } else if ((cells[i].e <= 0 && !cells[i].state) || cells[i].state == -1) {
             // kill the cell
-            int s = rand()%3;
+            start_random_stream(&random, seed, RANDOM_DEATH, step, cells[i].id, 0);
+            int s = next_random(&random)%3;
             while (cells[i].e) {
                 if (substances[s] > -cells[i].e) {
              		// substance is enough to add negative energy
@@ -857,73 +947,19 @@ void census_cells(Cell cells[MAX_CELLS], int *num_cells, Cell **selected_cell, u
            		    cells[i].e = 0;
                	} else {
               		// negative energy too great
-               		s = rand()%3;
+               		s = next_random(&random)%3;
               	}
             }
             (*num_cells)--;
-            if (*selected_cell == cells + *num_cells) {
-                *selected_cell = cells + i;
-            } else if (*selected_cell == cells + i) {
-                *selected_cell = NULL;
-                *hud_update = 1;
+            free_cell(cells + i, pool);
+            remove_spatial_cell(hash, i);
+            remove_handle(handles, cells[i].handle);
+            if (i != *num_cells) {
+                move_spatial_cell(hash, *num_cells, i);
+                move_handle(handles, cells[*num_cells].handle, i);
             }
-            free_cell(cells + i);
             cells[i] = cells[*num_cells];
+            copy_kinematics(kin, i, *num_cells);
         }
     }
 }
-
-void draw_cells(SDL_Surface *s, SDL_Rect view, Cell **cells_in_regions[][Y_REGIONS], int num_cells_in_regions[][Y_REGIONS], Cell *selected_cell) {
-    int i, j, k, l;
-    int right_region = (view.x + view.w - 1) / (AREA_WIDTH / X_REGIONS);
-    int bottom_region = (view.y + view.h - 1) / (AREA_HEIGHT / Y_REGIONS);
-    int left_region = view.x / (AREA_WIDTH / X_REGIONS);
-    int top_region = view.y / (AREA_HEIGHT / Y_REGIONS);
-    for (i = left_region; i <= right_region; i++) {
-        for (j = top_region; j <= bottom_region; j++) {
-            for (k = 0; k < num_cells_in_regions[i][j]; k++) {
-                if (!cells_in_regions[i][j][k]->organelles_set) {
-                    set_organelle_loc(cells_in_regions[i][j][k]->organelles, 0, 0,
-                            energy_scale(-cells_in_regions[i][j][k]->organelles->r, cells_in_regions[i][j][k]->e),
-                            cells_in_regions[i][j][k]->rot, cells_in_regions[i][j][k]->e);
-                    cells_in_regions[i][j][k]->organelles_set = 1;
-                }
-                if (!cells_in_regions[i][j][k]->drawn) {
-                    for (l = 0; l < cells_in_regions[i][j][k]->num_organelles; l++) {
-                        if (cells_in_regions[i][j][k]->state) {
-                            draw_circle(s, cells_in_regions[i][j][k]->organelles[l].x + cells_in_regions[i][j][k]->x - view.x,
-                                    cells_in_regions[i][j][k]->organelles[l].y + cells_in_regions[i][j][k]->y - view.y,
-                                    energy_scale(cells_in_regions[i][j][k]->organelles[l].r, cells_in_regions[i][j][k]->e),
-                                    map_state_color(cells_in_regions[i][j][k]->state, s->format));
-                        } else {
-                            draw_circle(s, cells_in_regions[i][j][k]->organelles[l].x + cells_in_regions[i][j][k]->x - view.x,
-                                    cells_in_regions[i][j][k]->organelles[l].y + cells_in_regions[i][j][k]->y - view.y,
-                                    energy_scale(cells_in_regions[i][j][k]->organelles[l].r, cells_in_regions[i][j][k]->e),
-                                    map_type_color(cells_in_regions[i][j][k]->organelles[l].type, s->format));
-                        }
-                    }
-                    if (cells_in_regions[i][j][k]->virus) {
-                        SDL_Rect r;
-                        r.x = cells_in_regions[i][j][k]->x - view.x -
-                            energy_scale(cells_in_regions[i][j][k]->organelles->r, cells_in_regions[i][j][k]->e);
-                        r.y = cells_in_regions[i][j][k]->y - view.y;
-                        r.w = energy_scale(cells_in_regions[i][j][k]->organelles->r * 2, cells_in_regions[i][j][k]->e);
-                        r.h = 1;
-                        SDL_FillRect(s, &r, map_type_color(cells_in_regions[i][j][k]->virus->primary_type, s->format));
-                        r.x = cells_in_regions[i][j][k]->x - view.x;
-                        r.y = cells_in_regions[i][j][k]->y - view.y -
-                            energy_scale(cells_in_regions[i][j][k]->organelles->r, cells_in_regions[i][j][k]->e);
-                        r.w = 1;
-                        r.h = energy_scale(cells_in_regions[i][j][k]->organelles->r * 2, cells_in_regions[i][j][k]->e);
-                        SDL_FillRect(s, &r, map_type_color(cells_in_regions[i][j][k]->virus->primary_type, s->format));
-                    }
-                    cells_in_regions[i][j][k]->drawn = 1;
-                }
-            }
-        }
-    }
-    if (selected_cell) {
-        draw_circle(s, selected_cell->x - view.x, selected_cell->y - view.y,
-                energy_scale(selected_cell->r, selected_cell->e), SDL_MapRGB(s->format, 192, 192, 192));
-    }
-}
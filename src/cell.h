@@ -19,11 +19,20 @@
 #define CELL_H
 
 #include <stdio.h>
-#include <SDL2/SDL.h>
+#include <stdlib.h>
 #include <math.h>
 
-#include "draw.h"
 #include "constants.h"
+#include "profile.h"
+#include "kinematics.h"
+#include "spatial.h"
+#include "pool.h"
+#include "genome.h"
+#include "workers.h"
+#include "rng.h"
+#include "handle.h"
+
+struct Broadphase;
 
 #define CELL_SPEED 145
 #define CELL_ROT_SPEED 14
@@ -45,58 +54,82 @@
 #define FRICTION 0.9995
 #define LN_FRICTION -0.00050012504168224286
 
-typedef struct Organelle {
-    // primary variables
-    double angle; // angle by which this organelle is offset from its parent
-    int r;
-    int type;
-    int parent_id;
-    // secondary variables
-    int x, y;
-    int num_children; // number of organelles from the same cell that branch off this one
-    struct Organelle **children;
-} Organelle;
-
+// position and motion are kept in a separate Kinematics structure indexed like the cell array
 typedef struct Cell {
+    unsigned long long id; // never changes or goes to another cell, and keys the cell's random numbers
+    CellHandle handle;
     // primary variables
-    int x, y, x_err, y_err;
-    double x_vel, y_vel;
-    double rot, rot_vel;
     int mov_counter, rot_counter;
     long e;
     int age;
     int state, state_counter;
-    int num_organelles;
-    Organelle *organelles;
-    struct Cell *virus;
-    // secondary variables
-    int r;
-    int type_counts[NUM_TYPES];
-    int primary_type;
-    int weight; // used for energy loss and movement
+    Genome *genome;
+    Genome *virus; // genome of the virus infecting this cell, or NULL
     // tertiary variables
-    int organelles_set, drawn;
-    int pause_motion;
+    int organelles_set; // whether the offsets below are up to date for this step
+    int *org_x, *org_y, *org_r; // organelle offsets from the centre and radii at the current energy and rotation
 } Cell;
 
+// organelle i of cell a overlapping organelle j of cell b
+typedef struct Contact {
+    int i, j;
+    int dx, dy; // from the centre of b's organelle to a's
+} Contact;
+
+// the collision phase finds contacts on every worker at once, then acts on them in pair order.
+// each worker keeps its own list, and each pair remembers where its contacts are in it
+typedef struct ContactList {
+    Contact *contacts;
+    int num_contacts, contacts_allocated;
+} ContactList;
+
+typedef struct Collisions {
+    ContactList lists[MAX_WORKERS];
+    int *firsts, *counts; // contacts of pair p are lists[chunk].contacts[firsts[p]] onwards
+    int pairs_allocated;
+} Collisions;
 
-void add_initial_cells(Cell cells[MAX_CELLS]);
-void set_organelle_loc(Organelle *cur_organelle, double parent_x, double parent_y, int parent_r, double cell_rot, int cell_e);
-// recursively checks each organelle to find the distance of the outermost point of the cell
-void set_secondary_variables(Cell *cell);
-void save_cell(FILE *fp, Cell *cell);
-void load_cell(FILE *fp, Cell *cell);
-void free_cell(Cell *cell);
-SDL_Color get_type_color(int type);
-Uint32 map_type_color(int type, SDL_PixelFormat *format);
-Uint32 map_state_color(int state, SDL_PixelFormat *format);
+// fills cells with a grid of random cells CELL_SPACE apart over a width by height area
+void add_initial_cells(Cell *cells, Kinematics *kin, Pool *pool, HandleTable *handles, int width, int height);
+// gives the cell at index the next id and a handle
+void register_cell(Cell *cell, HandleTable *handles, int index);
+// offsets from the centre and radii of the organelles of a cell with genome, energy e and rotation rot
+void locate_organelles(const Genome *genome, long e, double rot, int *x, int *y, int *r);
+// fills in the cell's organelle offsets and radii for its energy and rotation unless they're already set this step
+void set_organelle_locs(Cell *cell, double rot);
+// allocates space for the offsets filled in by set_organelle_locs
+void create_organelle_locs(Cell *cell, Pool *pool);
+void save_cell(FILE *fp, Cell *cell, Kinematics *kin, int cell_id);
+void load_cell(FILE *fp, Cell *cell, Kinematics *kin, int cell_id, Pool *pool);
+// a virus is stored like a cell with nothing but its organelles filled in
+void save_virus(FILE *fp, Genome *virus);
+Genome *load_virus(FILE *fp, Pool *pool);
+void free_cell(Cell *cell, Pool *pool);
 int energy_scale(int r, long e);
-void adjust_cells(Cell cells[MAX_CELLS], int num_cells, Cell **cells_in_regions[][Y_REGIONS], int num_cells_in_regions[][Y_REGIONS],
-        unsigned long long substances[3], int elapsed);
-void handle_cell_collisions(Cell *a_cell, Cell *b_cell);
-void handle_organelle_interaction(Cell *a_cell, Cell *b_cell, int a_type, int b_type);
-void handle_wall_collisions(Cell *cell);
-void census_cells(Cell cells[MAX_CELLS], int *num_cells, Cell **selected_cell, unsigned long long substances[3], int *hud_update);
-void draw_cells(SDL_Surface *s, SDL_Rect view, Cell **cells_in_regions[][Y_REGIONS], int num_cells_in_regions[][Y_REGIONS], Cell *selected_cell);
+// movement, walls and energy are split across the workers. random numbers come from streams keyed
+// on seed, step and the cells drawing them, so the result is the same for any number of threads.
+// the pairs of cells to collide come from broadphase. returns 0 if there wasn't the memory to
+// collide every pair, in which case the step went ahead without some of them
+int adjust_cells(Cell *cells, Kinematics *kin, int num_cells, SpatialHash *hash, struct Broadphase *broadphase,
+        const HandleTable *handles, Collisions *collisions, Workers *workers,
+        unsigned long long substances[3], int elapsed, unsigned long long seed, unsigned long step);
+// returns 0 if the lists could not be allocated. capacity is the number of cells to expect
+int create_collisions(Collisions *collisions, int capacity);
+void free_collisions(Collisions *collisions);
+// lists where the organelles of cells a and b overlap, whose offsets must already be set.
+// returns 0 if the list couldn't grow and is incomplete
+int find_contacts(Cell *cells, Kinematics *kin, int a, int b, ContactList *list);
+// pushes cells a and b apart and starts any interaction between them, from their contacts in the order found
+void handle_cell_collisions(Cell *cells, Kinematics *kin, int a, int b, Contact *contacts, int num_contacts,
+        RandomStream *random);
+void handle_organelle_interaction(Cell *a_cell, Cell *b_cell, int a_type, int b_type, RandomStream *random);
+// keeps the cell inside a width by height area
+void handle_wall_collisions(Cell *cell, Kinematics *kin, int cell_id, int width, int height);
+// hash must have been built from the cells as they are now, and is kept up to date with births and deaths.
+// there must be room in cells, kin, hash and handles for every child born, and none are born once
+// there are max_cells. cells move about the array as others die, so keep handles to them rather than pointers
+void census_cells(Cell *cells, Kinematics *kin, int *num_cells, int max_cells, SpatialHash *hash,
+        HandleTable *handles, Pool *pool, unsigned long long substances[3], unsigned long long seed,
+        unsigned long step);
 
 #endif
@@ -0,0 +1,107 @@
+/*  This file is part of Cellbowl.
+
+    Cellbowl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Cellbowl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Cellbowl.  If not, see <https://www.gnu.org/licenses/>. 
+    
+    © Tom Rodgers 2010-2019
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "world.h"
+
+// checks that every broadphase finds the same pairs on every step of the state files given,
+// with one thread and with several, and that the thread count doesn't change the outcome
+
+#define CHECK_STEPS 500
+#define CHECK_STEP_MS 8
+#define CHECK_SEED 1
+
+static const int thread_counts[] = {1, 3};
+
+static int same_pairs(const SpatialHash *a, const SpatialHash *b) {
+    return a->num_pairs == b->num_pairs && !memcmp(a->pairs, b->pairs, a->num_pairs * sizeof(*a->pairs));
+}
+
+// 0 if some broadphase found different pairs from the grid or a world couldn't be set up.
+// the number of cells left at the end goes in num_cells
+static int check_state(const char *filename, int threads, int *num_cells) {
+    WorldConfig config;
+    World *worlds[NUM_BROADPHASES];
+    int k, step, ok = 1;
+    default_world_config(&config);
+    for (k = 0; k < NUM_BROADPHASES; k++) {
+        config.broadphase = k;
+        srand(CHECK_SEED);
+        worlds[k] = create_world(&config, threads, CHECK_SEED);
+        if (worlds[k] == NULL || !load_state_file(worlds[k], filename)) {
+            fprintf(stderr, "Could not set up %s with the %s broadphase\n", filename, broadphase_names[k]);
+            if (worlds[k]) free_world(worlds[k]);
+            while (k--) {
+                free_world(worlds[k]);
+            }
+            return 0;
+        }
+    }
+    for (step = 0; step < CHECK_STEPS && ok; step++) {
+        for (k = 0; k < NUM_BROADPHASES; k++) {
+            if (!step_world(worlds[k], CHECK_STEP_MS)) {
+                fprintf(stderr, "%s: out of memory for collisions with the %s broadphase\n", filename, broadphase_names[k]);
+                ok = 0;
+            }
+        }
+        for (k = 1; k < NUM_BROADPHASES && ok; k++) {
+            if (!same_pairs(&worlds[0]->hash, &worlds[k]->hash)) {
+                printf("%s, %d threads: %s found %d pairs and %s %d on step %d\n", filename, threads,
+                        broadphase_names[0], worlds[0]->hash.num_pairs, broadphase_names[k],
+                        worlds[k]->hash.num_pairs, step);
+                ok = 0;
+            }
+        }
+    }
+    if (ok) {
+        printf("%s, %d threads: the same pairs for %d steps, %d cells at the end\n", filename, threads,
+                CHECK_STEPS, worlds[0]->num_cells);
+    }
+    *num_cells = worlds[0]->num_cells;
+    for (k = 0; k < NUM_BROADPHASES; k++) {
+        free_world(worlds[k]);
+    }
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    int i, t, failed = 0;
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s STATE_FILE...\n", argv[0]);
+        return 1;
+    }
+    for (i = 1; i < argc; i++) {
+        int first_cells = -1;
+        for (t = 0; t < (int)(sizeof(thread_counts) / sizeof(*thread_counts)); t++) {
+            int num_cells;
+            if (!check_state(argv[i], thread_counts[t], &num_cells)) {
+                failed = 1;
+            } else if (first_cells < 0) {
+                first_cells = num_cells;
+            } else if (num_cells != first_cells) {
+                // the thread count mustn't change what happens either
+                printf("%s: %d cells with %d threads but %d with %d\n", argv[i], num_cells, thread_counts[t],
+                        first_cells, thread_counts[0]);
+                failed = 1;
+            }
+        }
+    }
+    return failed;
+}
@@ -0,0 +1,111 @@
+/*  This file is part of Cellbowl.
+
+    Cellbowl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Cellbowl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Cellbowl.  If not, see <https://www.gnu.org/licenses/>. 
+    
+    © Tom Rodgers 2010-2019
+*/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kinematics.h"
+
+// checks that every integration kernel this CPU can run moves cells exactly as the scalar one does
+
+#define CHECK_CELLS 1003
+#define CHECK_STEPS 50
+
+static double random_double(double lo, double hi) {
+    return lo + (hi - lo) * rand() / RAND_MAX;
+}
+
+static void fill_random(Kinematics *kin, int n) {
+    int i;
+    for (i = 0; i < n; i++) {
+        kin->x[i] = rand() % 10000;
+        kin->y[i] = rand() % 10000;
+        kin->x_err[i] = rand() % 1999 - 999;
+        kin->y_err[i] = rand() % 1999 - 999;
+        kin->x_vel[i] = random_double(-3000, 3000);
+        kin->y_vel[i] = random_double(-3000, 3000);
+        // some right at the ends of a turn, where the kernels have to wrap the same way
+        kin->rot[i] = i % 7 ? random_double(0, M_PI * 2) : (i % 2 ? 0 : nextafter(M_PI * 2, 0));
+        kin->rot_vel[i] = random_double(-50, 50);
+        kin->pause_motion[i] = rand() % 4 == 0;
+    }
+}
+
+static void copy_all(Kinematics *dst, const Kinematics *src, int n) {
+    memcpy(dst->x, src->x, n * sizeof(*dst->x));
+    memcpy(dst->y, src->y, n * sizeof(*dst->y));
+    memcpy(dst->x_err, src->x_err, n * sizeof(*dst->x_err));
+    memcpy(dst->y_err, src->y_err, n * sizeof(*dst->y_err));
+    memcpy(dst->x_vel, src->x_vel, n * sizeof(*dst->x_vel));
+    memcpy(dst->y_vel, src->y_vel, n * sizeof(*dst->y_vel));
+    memcpy(dst->rot, src->rot, n * sizeof(*dst->rot));
+    memcpy(dst->rot_vel, src->rot_vel, n * sizeof(*dst->rot_vel));
+    memcpy(dst->pause_motion, src->pause_motion, n * sizeof(*dst->pause_motion));
+}
+
+static int same_all(const Kinematics *a, const Kinematics *b, int n) {
+    return !memcmp(a->x, b->x, n * sizeof(*a->x)) && !memcmp(a->y, b->y, n * sizeof(*a->y)) &&
+        !memcmp(a->x_err, b->x_err, n * sizeof(*a->x_err)) && !memcmp(a->y_err, b->y_err, n * sizeof(*a->y_err)) &&
+        !memcmp(a->x_vel, b->x_vel, n * sizeof(*a->x_vel)) && !memcmp(a->y_vel, b->y_vel, n * sizeof(*a->y_vel)) &&
+        !memcmp(a->rot, b->rot, n * sizeof(*a->rot)) && !memcmp(a->rot_vel, b->rot_vel, n * sizeof(*a->rot_vel));
+}
+
+// steps kin with the kernel called name, over ranges that don't start or end on a vector's width
+static void run_kernel(Kinematics *kin, const char *name) {
+    int step;
+    use_kinematics_kernel(name);
+    for (step = 0; step < CHECK_STEPS; step++) {
+        int start = step % 5;
+        int end = CHECK_CELLS - step % 3;
+        integrate_kinematics(kin, start, end, 1 + step % 40);
+    }
+}
+
+int main(void) {
+    const char *kernels[] = {"sse2", "avx2"};
+    Kinematics initial, expected, actual;
+    int k, failed = 0;
+    if (!create_kinematics(&initial, CHECK_CELLS) || !create_kinematics(&expected, CHECK_CELLS) ||
+            !create_kinematics(&actual, CHECK_CELLS)) {
+        fprintf(stderr, "Could not allocate kinematics\n");
+        return 1;
+    }
+    srand(1);
+    fill_random(&initial, CHECK_CELLS);
+    copy_all(&expected, &initial, CHECK_CELLS);
+    run_kernel(&expected, "scalar");
+    for (k = 0; k < (int)(sizeof(kernels) / sizeof(*kernels)); k++) {
+        if (!use_kinematics_kernel(kernels[k])) {
+            printf("%s: not supported here, skipped\n", kernels[k]);
+            continue;
+        }
+        copy_all(&actual, &initial, CHECK_CELLS);
+        run_kernel(&actual, kernels[k]);
+        if (same_all(&expected, &actual, CHECK_CELLS)) {
+            printf("%s: same as scalar\n", kernels[k]);
+        } else {
+            printf("%s: differs from scalar\n", kernels[k]);
+            failed = 1;
+        }
+    }
+    free_kinematics(&initial);
+    free_kinematics(&expected);
+    free_kinematics(&actual);
+    return failed;
+}
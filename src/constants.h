@@ -18,19 +18,35 @@
 #ifndef CONSTANTS_H
 #define CONSTANTS_H
 
+// the classic bowl, which --width, --height and --min-bucket change
 #define AREA_WIDTH 3600
 #define AREA_HEIGHT 2160
-#define X_REGIONS 10
-#define Y_REGIONS 6
+#define SPATIAL_MIN_BUCKET_SIZE 32
 
 #define SCREEN_WIDTH 1920
 #define SCREEN_HEIGHT 1080
 #define HUD_HEIGHT 150
 #define VIEW_HEIGHT (SCREEN_HEIGHT - HUD_HEIGHT)
 #define SCREEN_DEPTH 32
+// largest circle radius drawn from a precomputed stamp, organelles are at most 9
+#define CIRCLE_STAMP_MAX_R 16
+// bytes of cell sprites kept before the least recently drawn are evicted
+#define SPRITE_CACHE_BUDGET (8 << 20)
 
+// default population cap and initial room for cells, changed with --max-cells and --capacity
 #define MAX_CELLS 1200
 #define CELL_SPACE 180
+// steps between re-sorts of the cell array along a Z-order curve, changed with --sort-steps
+#define DEFAULT_SORT_STEPS 64
+// the curve is traced through squares this many bits wide
+#define MORTON_SHIFT 4
+// margin in pixels of the verlet neighbour lists, changed with --skin
+#define DEFAULT_SKIN 16
+
+#define DEFAULT_STEP_MS 8
+#define MAX_STEPS_PER_FRAME 8
+// simulated time between minimap redraws while the view and selection stay put
+#define DEFAULT_MINIMAP_MS 100
 
 #define NUM_TYPES 9
 
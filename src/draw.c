@@ -1,212 +1,764 @@
-/*  This file is part of Cellbowl.
-
-    Cellbowl is free software: you can redistribute it and/or modify
-    it under the terms of the GNU General Public License as published by
-    the Free Software Foundation, either version 3 of the License, or
-    (at your option) any later version.
-
-    Cellbowl is distributed in the hope that it will be useful,
-    but WITHOUT ANY WARRANTY; without even the implied warranty of
-    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
-    GNU General Public License for more details.
-
-    You should have received a copy of the GNU General Public License
-    along with Cellbowl.  If not, see <https://www.gnu.org/licenses/>. 
-    
-    © Tom Rodgers 2010-2019
-*/
-#include "draw.h"
-
-void draw_text(SDL_Surface *s, TTF_Font *font, int x, int y, int x_align, int y_align, SDL_Color color, char *fmt, ...) {
-    va_list ap;
-    va_start(ap, fmt);
-    int len = vsnprintf(NULL, 0, fmt, ap);
-    va_end(ap);
-    if (len <= 0) return;
-    char *str = malloc(len + 1);
-    if (str == NULL) return;
-    va_start(ap, fmt);
-    vsprintf(str, fmt, ap);
-    va_end(ap);
-    SDL_Surface *text = TTF_RenderText_Solid(font, str, color);
-    free(str);
-    SDL_Rect r;
-    switch (x_align) {
-        case -1:
-            r.x = x;
-            break;
-        case 0:
-            r.x = x - text->w / 2;
-            break;
-        case 1:
-            r.x = x - text->w;
-            break;
-    }
-    switch (y_align) {
-        case -1:
-            r.y = y;
-            break;
-        case 0:
-            r.y = y - text->h / 2;
-            break;
-        case 1:
-            r.y = y - text->h;
-            break;
-    }
-    SDL_BlitSurface(text, NULL, s, &r);
-    SDL_FreeSurface(text);
-}
-
-void draw_circle(SDL_Surface *s, int cx, int cy, int r, Uint32 color) {
-    int x = 0;
-    int y = r;
-    int d = 1 - r;
-    if (cx - r >= 0 && cx + r < s->w && cy - r >= 0 && cy + r < s->h) {
-        draw_circle_symmetry_points(s, cx, cy, x, y, color, 0);
-        while (x < y) {
-            x++;
-            if (d < 0) {
-                d += (x << 1) + 1;
-            } else {
-                y--;
-                d += ((x-y) << 1) + 1;
-            }
-            draw_circle_symmetry_points(s, cx, cy, x, y, color, 0);
-        }
-    } else if (cx + r >= 0 && cx - r < s->w && cy + r >= 0 && cy - r < s->h) {
-        // circle is partially on surface, must check bounds
-        draw_circle_symmetry_points(s, cx, cy, x, y, color, 1);
-        while (x < y) {
-            x++;
-            if (d < 0) {
-                d += (x << 1) + 1;
-            } else {
-                y--;
-                d += ((x-y) << 1) + 1;
-            }
-            draw_circle_symmetry_points(s, cx, cy, x, y, color, 1);
-        }
-    }
-}
-
-void draw_circle_symmetry_points(SDL_Surface *s, int cx, int cy, int x, int y, Uint32 color, int check_bounds) {
-    if (check_bounds) {
-        if (cx + x >= 0 && cx + x < s->w && cy + y >= 0 && cy + y < s->h) {
-            draw_pixel(s, (cx + x), (cy + y), color);
-        }
-        if (cx + x >= 0 && cx + x < s->w && cy - y >= 0 && cy - y < s->h) {
-            draw_pixel(s, (cx + x), (cy - y), color);
-        }
-        if (cx - x >= 0 && cx - x < s->w && cy + y >= 0 && cy + y < s->h) {
-            draw_pixel(s, (cx - x), (cy + y), color);
-        }
-        if (cx - x >= 0 && cx - x < s->w && cy - y >= 0 && cy - y < s->h) {
-            draw_pixel(s, (cx - x), (cy - y), color);
-        }
-        if (cx + y >= 0 && cx + y < s->w && cy + x >= 0 && cy + x < s->h) {
-            draw_pixel(s, (cx + y), (cy + x), color);
-        }
-        if (cx + y >= 0 && cx + y < s->w && cy - x >= 0 && cy - x < s->h) {
-            draw_pixel(s, (cx + y), (cy - x), color);
-        }
-        if (cx - y >= 0 && cx - y < s->w && cy + x >= 0 && cy + x < s->h) {
-            draw_pixel(s, (cx - y), (cy + x), color);
-        }
-        if (cx - y >= 0 && cx - y < s->w && cy - x >= 0 && cy - x < s->h) {
-            draw_pixel(s, (cx - y), (cy - x), color);
-        }
-    } else {
-        draw_pixel(s, (cx + x), (cy + y), color);
-        draw_pixel(s, (cx + x), (cy - y), color);
-        draw_pixel(s, (cx - x), (cy + y), color);
-        draw_pixel(s, (cx - x), (cy - y), color);
-        draw_pixel(s, (cx + y), (cy + x), color);
-        draw_pixel(s, (cx + y), (cy - x), color);
-        draw_pixel(s, (cx - y), (cy + x), color);
-        draw_pixel(s, (cx - y), (cy - x), color);
-    }
-}
-
-void draw_line(SDL_Surface *s, int xi, int yi, int xf, int yf, Uint32 color) {
-    char steep = abs(yf - yi) > abs(xf - xi);
-    if (steep) {
-        int swap;
-        swap = xi;
-        xi = yi;
-        yi = swap;
-        swap = xf;
-        xf = yf;
-        yf = swap;
-    }
-    if (xi > xf) {
-        int swap;
-        swap = xi;
-        xi = xf;
-        xf = swap;
-        swap = yi;
-        yi = yf;
-        yf = swap;
-    }
-    int dx = xf - xi;
-    int dy = abs(yf - yi);
-    int error = dx / 2;
-    int ystep;
-    int y = yi;
-    if (yi < yf) {
-        ystep = 1;
-    } else {
-        ystep = -1;
-    }
-    int x;
-    for (x = xi; x <= xf; x++) {
-        if (steep) {
-            if (x >= 0 && x < s->h && y >= 0 && y < s->w) {
-                draw_pixel(s, y, x, color);
-            }
-        } else {
-            if (x >= 0 && x < s->w && y >= 0 && y < s->h) {
-                draw_pixel(s, x, y, color);
-            }
-        }
-        error -= dy;
-        if (error < 0) {
-            y += ystep;
-            error += dx;
-        }
-    }
-}
-
-void draw_pixel(SDL_Surface *s, int x, int y, Uint32 color) {
-    int bpp = s->format->BytesPerPixel;
-    Uint8 *p = (Uint8 *)s->pixels + y * s->pitch + x * bpp;
-
-    switch (bpp) {
-        case 1:
-            *p = color;
-            break;
-
-        case 2:
-            *(Uint16 *)p = color;
-            break;
-
-        case 3:
-            if (SDL_BYTEORDER == SDL_BIG_ENDIAN) {
-                p[0] = (color >> 16) & 0xff;
-                p[1] = (color >> 8) & 0xff;
-                p[2] = color & 0xff;
-            }
-            else {
-                p[0] = color & 0xff;
-                p[1] = (color >> 8) & 0xff;
-                p[2] = (color >> 16) & 0xff;
-            }
-            break;
-
-        case 4:
-            *(Uint32 *)p = color;
-            break;
-
-       default:
-            break;
-    }
-}
+/*  This file is part of Cellbowl.
+
+    Cellbowl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Cellbowl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Cellbowl.  If not, see <https://www.gnu.org/licenses/>. 
+    
+    © Tom Rodgers 2010-2019
+*/
+#include "draw.h"
+#include "sprite.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// glyphs of the HUD font rendered once at load, so that text is drawn without rendering
+// surfaces or allocating; their widths are summed, as the font is monospaced and unkerned
+typedef struct GlyphAtlas {
+    Uint8 *mask; // every glyph side by side, non-zero where it is drawn
+    int pitch;
+    int height;
+    int x[GLYPH_LAST + 1], w[GLYPH_LAST + 1]; // columns of each glyph in the mask
+} GlyphAtlas;
+
+static GlyphAtlas glyphs = {NULL};
+
+int create_glyph_atlas(TTF_Font *font) {
+    int c, x, y;
+    SDL_Color white = {255, 255, 255, 255};
+    free_glyph_atlas();
+    glyphs.height = TTF_FontHeight(font);
+    glyphs.pitch = 0;
+    for (c = GLYPH_FIRST; c <= GLYPH_LAST; c++) {
+        char str[2] = {c, '\0'};
+        int h;
+        if (TTF_SizeText(font, str, glyphs.w + c, &h)) return 0;
+        glyphs.x[c] = glyphs.pitch;
+        glyphs.pitch += glyphs.w[c];
+    }
+    glyphs.mask = calloc(glyphs.pitch * glyphs.height, 1);
+    if (glyphs.mask == NULL) return 0;
+    for (c = GLYPH_FIRST; c <= GLYPH_LAST; c++) {
+        char str[2] = {c, '\0'};
+        SDL_Surface *glyph = TTF_RenderText_Solid(font, str, white);
+        // a blank glyph such as the space may have nothing to render
+        if (glyph == NULL) continue;
+        // solid text is rendered 8-bit, with the background at index 0
+        if (glyph->format->BytesPerPixel == 1) {
+            int w = glyph->w < glyphs.w[c] ? glyph->w : glyphs.w[c];
+            int h = glyph->h < glyphs.height ? glyph->h : glyphs.height;
+            for (y = 0; y < h; y++) {
+                Uint8 *src = (Uint8 *)glyph->pixels + y * glyph->pitch;
+                for (x = 0; x < w; x++) {
+                    glyphs.mask[y * glyphs.pitch + glyphs.x[c] + x] = src[x] != 0;
+                }
+            }
+        }
+        SDL_FreeSurface(glyph);
+    }
+    return 1;
+}
+
+void free_glyph_atlas(void) {
+    free(glyphs.mask);
+    glyphs.mask = NULL;
+}
+
+// draws str with its top left corner at x, y, clipped to the surface
+static void draw_glyphs(SDL_Surface *s, const char *str, int x, int y, Uint32 color) {
+    int row, col;
+    int top = y < 0 ? -y : 0;
+    int bottom = y + glyphs.height > s->h ? s->h - y : glyphs.height;
+    for (row = top; row < bottom; row++) {
+        Uint32 *dst = (Uint32 *)((Uint8 *)s->pixels + (y + row) * s->pitch);
+        const Uint8 *mask_row = glyphs.mask + row * glyphs.pitch;
+        int left = x;
+        const char *c;
+        for (c = str; *c; c++) {
+            int g = *c >= GLYPH_FIRST && *c <= GLYPH_LAST ? *c : '?';
+            const Uint8 *mask = mask_row + glyphs.x[g];
+            int start = left < 0 ? -left : 0;
+            int end = left + glyphs.w[g] > s->w ? s->w - left : glyphs.w[g];
+            for (col = start; col < end; col++) {
+                if (mask[col]) dst[left + col] = color;
+            }
+            left += glyphs.w[g];
+        }
+    }
+}
+
+// draws str aligned to x, y and returns the area it covers
+static SDL_Rect draw_string(SDL_Surface *s, TTF_Font *font, int x, int y, int x_align, int y_align,
+        SDL_Color color, const char *str) {
+    SDL_Rect r = {0, 0, 0, 0};
+    SDL_Surface *text = NULL;
+    if (glyphs.mask) {
+        const char *c;
+        for (c = str; *c; c++) {
+            r.w += glyphs.w[*c >= GLYPH_FIRST && *c <= GLYPH_LAST ? *c : '?'];
+        }
+        r.h = glyphs.height;
+    } else {
+        text = TTF_RenderText_Solid(font, str, color);
+        if (text == NULL) return r;
+        r.w = text->w;
+        r.h = text->h;
+    }
+    switch (x_align) {
+        case -1:
+            r.x = x;
+            break;
+        case 0:
+            r.x = x - r.w / 2;
+            break;
+        case 1:
+            r.x = x - r.w;
+            break;
+    }
+    switch (y_align) {
+        case -1:
+            r.y = y;
+            break;
+        case 0:
+            r.y = y - r.h / 2;
+            break;
+        case 1:
+            r.y = y - r.h;
+            break;
+    }
+    if (text) {
+        SDL_Rect dst = r;
+        SDL_BlitSurface(text, NULL, s, &dst);
+        SDL_FreeSurface(text);
+    } else {
+        draw_glyphs(s, str, r.x, r.y, SDL_MapRGB(s->format, color.r, color.g, color.b));
+    }
+    return r;
+}
+
+void draw_text(SDL_Surface *s, TTF_Font *font, int x, int y, int x_align, int y_align, SDL_Color color, char *fmt, ...) {
+    char str[TEXT_MAX_LEN];
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(str, sizeof(str), fmt, ap);
+    va_end(ap);
+    if (len <= 0) return;
+    draw_string(s, font, x, y, x_align, y_align, color, str);
+}
+
+void draw_text_slot(SDL_Surface *s, TTF_Font *font, TextSlot *slot, int x, int y, int x_align, int y_align,
+        SDL_Color color, char *fmt, ...) {
+    char str[TEXT_MAX_LEN];
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(str, sizeof(str), fmt, ap);
+    va_end(ap);
+    if (len < 0) return;
+    slot->used = 1;
+    if (slot->drawn && slot->x == x && slot->y == y && slot->x_align == x_align && slot->y_align == y_align &&
+            slot->color.r == color.r && slot->color.g == color.g && slot->color.b == color.b &&
+            !strcmp(slot->text, str)) {
+        return;
+    }
+    if (slot->drawn) {
+        SDL_FillRect(s, &slot->rect, SDL_MapRGB(s->format, 0, 0, 0));
+    }
+    strcpy(slot->text, str);
+    slot->x = x;
+    slot->y = y;
+    slot->x_align = x_align;
+    slot->y_align = y_align;
+    slot->color = color;
+    slot->rect = draw_string(s, font, x, y, x_align, y_align, color, str);
+    slot->drawn = 1;
+}
+
+void reset_text_slots(TextSlot *slots, int num_slots) {
+    int i;
+    for (i = 0; i < num_slots; i++) {
+        slots[i].drawn = 0;
+        slots[i].used = 0;
+    }
+}
+
+void clear_unused_text_slots(SDL_Surface *s, TextSlot *slots, int num_slots) {
+    int i;
+    for (i = 0; i < num_slots; i++) {
+        if (slots[i].drawn && !slots[i].used) {
+            SDL_FillRect(s, &slots[i].rect, SDL_MapRGB(s->format, 0, 0, 0));
+            slots[i].drawn = 0;
+        }
+        slots[i].used = 0;
+    }
+}
+
+// every surface drawn on is created in main.c with SCREEN_DEPTH bits per pixel, so the
+// rasterizer writes whole pixels straight into the rows instead of switching on the format
+#if SCREEN_DEPTH != 32
+#error "draw.c only rasterizes to 32-bit surfaces"
+#endif
+
+static inline Uint32 *pixel_row(SDL_Surface *s, int y) {
+    return (Uint32 *)((Uint8 *)s->pixels + y * s->pitch);
+}
+
+void fill_span(Uint32 *p, int n, Uint32 color) {
+    int i = 0;
+#ifdef __SSE2__
+    if (n >= 8) {
+        __m128i c = _mm_set1_epi32(color);
+        for (; i + 4 <= n; i += 4) {
+            _mm_storeu_si128((__m128i *)(p + i), c);
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        p[i] = color;
+    }
+}
+
+// fills columns x0 to x1 of a row, clipped to the surface width
+static inline void fill_clipped_span(Uint32 *row, int x0, int x1, int w, Uint32 color) {
+    if (x0 < 0) x0 = 0;
+    if (x1 >= w) x1 = w - 1;
+    if (x0 <= x1) fill_span(row + x0, x1 - x0 + 1, color);
+}
+
+// row extents of the midpoint circle of radius r, grown to fit the largest radius seen;
+// the outline on the rows dy above and below the centre covers columns lo[dy] to hi[dy]
+// either side of it
+static int *circle_extents = NULL;
+static int circle_extents_allocated = 0;
+
+static int *get_circle_extents(int r) {
+    if ((r + 1) * 2 > circle_extents_allocated) {
+        int *extents = realloc(circle_extents, sizeof(*circle_extents) * (r + 1) * 2);
+        if (extents == NULL) return NULL;
+        circle_extents = extents;
+        circle_extents_allocated = (r + 1) * 2;
+    }
+    int *lo = circle_extents;
+    int *hi = circle_extents + r + 1;
+    int i;
+    for (i = 0; i <= r; i++) {
+        lo[i] = r + 1;
+        hi[i] = -1;
+    }
+    int x = 0;
+    int y = r;
+    int d = 1 - r;
+    while (1) {
+        // each point covers its own row and, mirrored about the diagonal, row x
+        if (x < lo[y]) lo[y] = x;
+        if (x > hi[y]) hi[y] = x;
+        if (y < lo[x]) lo[x] = y;
+        if (y > hi[x]) hi[x] = y;
+        if (x >= y) break;
+        x++;
+        if (d < 0) {
+            d += (x << 1) + 1;
+        } else {
+            y--;
+            d += ((x-y) << 1) + 1;
+        }
+    }
+    return circle_extents;
+}
+
+// outline and filled offsets of every circle up to max_r, built by create_circle_stamps so that
+// most circles are drawn by writing a fixed list of pixels after one clip test
+typedef struct CircleStamps {
+    int max_r;
+    int pitch; // surface pitch in pixels that the offsets were made for
+    int *extents; // lo and hi row extents of radius r start at extents[(r * r + r)]
+    int *outline_starts; // the offsets of radius r are outline_starts[r] to outline_starts[r + 1]
+    int *fill_starts;
+    short *outline_x, *outline_y;
+    short *fill_x, *fill_y;
+    int *outline_offsets, *fill_offsets; // y * pitch + x
+} CircleStamps;
+
+static CircleStamps stamps = {.max_r = -1};
+
+// add the offsets of one row of a circle, with the centre column only once
+static int add_stamp_row(short *xs, short *ys, int n, int y, int lo, int hi) {
+    int x;
+    for (x = -hi; x <= -lo; x++) {
+        xs[n] = x;
+        ys[n++] = y;
+    }
+    for (x = lo > 0 ? lo : 1; x <= hi; x++) {
+        xs[n] = x;
+        ys[n++] = y;
+    }
+    return n;
+}
+
+static void set_stamp_pitch(int pitch) {
+    int i;
+    for (i = 0; i < stamps.outline_starts[stamps.max_r + 1]; i++) {
+        stamps.outline_offsets[i] = stamps.outline_y[i] * pitch + stamps.outline_x[i];
+    }
+    for (i = 0; i < stamps.fill_starts[stamps.max_r + 1]; i++) {
+        stamps.fill_offsets[i] = stamps.fill_y[i] * pitch + stamps.fill_x[i];
+    }
+    stamps.pitch = pitch;
+}
+
+int create_circle_stamps(int max_r) {
+    int r, y;
+    free_circle_stamps();
+    if (max_r < 0) return 1;
+    // at most (2r + 1)^2 pixels for each radius
+    long max_pixels = 0;
+    for (r = 0; r <= max_r; r++) {
+        max_pixels += (2 * r + 1) * (2 * r + 1);
+    }
+    stamps.extents = malloc(sizeof(*stamps.extents) * (max_r + 1) * (max_r + 2));
+    stamps.outline_starts = malloc(sizeof(*stamps.outline_starts) * (max_r + 2));
+    stamps.fill_starts = malloc(sizeof(*stamps.fill_starts) * (max_r + 2));
+    stamps.outline_x = malloc(sizeof(*stamps.outline_x) * max_pixels);
+    stamps.outline_y = malloc(sizeof(*stamps.outline_y) * max_pixels);
+    stamps.fill_x = malloc(sizeof(*stamps.fill_x) * max_pixels);
+    stamps.fill_y = malloc(sizeof(*stamps.fill_y) * max_pixels);
+    stamps.outline_offsets = malloc(sizeof(*stamps.outline_offsets) * max_pixels);
+    stamps.fill_offsets = malloc(sizeof(*stamps.fill_offsets) * max_pixels);
+    stamps.max_r = max_r;
+    if (stamps.extents == NULL || stamps.outline_starts == NULL || stamps.fill_starts == NULL ||
+            stamps.outline_x == NULL || stamps.outline_y == NULL || stamps.fill_x == NULL ||
+            stamps.fill_y == NULL || stamps.outline_offsets == NULL || stamps.fill_offsets == NULL) {
+        free_circle_stamps();
+        return 0;
+    }
+    int num_outline = 0;
+    int num_fill = 0;
+    for (r = 0; r <= max_r; r++) {
+        int *lo = get_circle_extents(r);
+        if (lo == NULL) {
+            free_circle_stamps();
+            return 0;
+        }
+        int *hi = lo + r + 1;
+        memcpy(stamps.extents + r * r + r, lo, sizeof(*lo) * (r + 1) * 2);
+        stamps.outline_starts[r] = num_outline;
+        stamps.fill_starts[r] = num_fill;
+        for (y = -r; y <= r; y++) {
+            int row = abs(y);
+            num_outline = add_stamp_row(stamps.outline_x, stamps.outline_y, num_outline, y, lo[row], hi[row]);
+            num_fill = add_stamp_row(stamps.fill_x, stamps.fill_y, num_fill, y, 0, hi[row]);
+        }
+    }
+    stamps.outline_starts[max_r + 1] = num_outline;
+    stamps.fill_starts[max_r + 1] = num_fill;
+    stamps.pitch = 0; // the offsets are made for the first surface stamped on
+    return 1;
+}
+
+void free_circle_stamps(void) {
+    free(stamps.extents);
+    free(stamps.outline_starts);
+    free(stamps.fill_starts);
+    free(stamps.outline_x);
+    free(stamps.outline_y);
+    free(stamps.fill_x);
+    free(stamps.fill_y);
+    free(stamps.outline_offsets);
+    free(stamps.fill_offsets);
+    stamps = (CircleStamps){.max_r = -1};
+}
+
+// writes the pixels at offsets from the centre, which must leave them all on the surface
+static inline void stamp_circle(SDL_Surface *s, int cx, int cy, const int *offsets, int n, Uint32 color) {
+    if (s->pitch / (int)sizeof(Uint32) != stamps.pitch) {
+        set_stamp_pitch(s->pitch / sizeof(Uint32));
+    }
+    Uint32 *centre = pixel_row(s, cy) + cx;
+    int i;
+    for (i = 0; i < n; i++) {
+        centre[offsets[i]] = color;
+    }
+}
+
+int *find_circle_extents(int r) {
+    if (r <= stamps.max_r) return stamps.extents + r * r + r;
+    return get_circle_extents(r);
+}
+
+void draw_circle(SDL_Surface *s, int cx, int cy, int r, Uint32 color) {
+    if (r < 0 || cx + r < 0 || cx - r >= s->w || cy + r < 0 || cy - r >= s->h) return;
+    int fully_visible = cx - r >= 0 && cx + r < s->w && cy - r >= 0 && cy + r < s->h;
+    if (fully_visible && r <= stamps.max_r) {
+        stamp_circle(s, cx, cy, stamps.outline_offsets + stamps.outline_starts[r],
+                stamps.outline_starts[r + 1] - stamps.outline_starts[r], color);
+        return;
+    }
+    int *lo = find_circle_extents(r);
+    if (lo == NULL) return;
+    int *hi = lo + r + 1;
+    int dy;
+    if (fully_visible) {
+        for (dy = -r; dy <= r; dy++) {
+            int row = abs(dy);
+            Uint32 *p = pixel_row(s, cy + dy) + cx;
+            fill_span(p - hi[row], hi[row] - lo[row] + 1, color);
+            fill_span(p + lo[row], hi[row] - lo[row] + 1, color);
+        }
+    } else {
+        // circle is partially on surface, clip the rows once and the spans to the width
+        int top = cy - r < 0 ? -cy : -r;
+        int bottom = cy + r >= s->h ? s->h - 1 - cy : r;
+        for (dy = top; dy <= bottom; dy++) {
+            int row = abs(dy);
+            Uint32 *p = pixel_row(s, cy + dy);
+            fill_clipped_span(p, cx - hi[row], cx - lo[row], s->w, color);
+            fill_clipped_span(p, cx + lo[row], cx + hi[row], s->w, color);
+        }
+    }
+}
+
+void draw_filled_circle(SDL_Surface *s, int cx, int cy, int r, Uint32 color) {
+    if (r < 0 || cx + r < 0 || cx - r >= s->w || cy + r < 0 || cy - r >= s->h) return;
+    if (r <= stamps.max_r && cx - r >= 0 && cx + r < s->w && cy - r >= 0 && cy + r < s->h) {
+        stamp_circle(s, cx, cy, stamps.fill_offsets + stamps.fill_starts[r],
+                stamps.fill_starts[r + 1] - stamps.fill_starts[r], color);
+        return;
+    }
+    int *lo = find_circle_extents(r);
+    if (lo == NULL) return;
+    int *hi = lo + r + 1;
+    int top = cy - r < 0 ? -cy : -r;
+    int bottom = cy + r >= s->h ? s->h - 1 - cy : r;
+    int dy;
+    for (dy = top; dy <= bottom; dy++) {
+        int row = abs(dy);
+        fill_clipped_span(pixel_row(s, cy + dy), cx - hi[row], cx + hi[row], s->w, color);
+    }
+}
+
+// smallest and largest k where y = yi + ystep * m(k) lies in [0, h), with m(k) the number of
+// minor steps Bresenham has taken after k major steps; returns 0 if there are none
+static int clip_minor_axis(int yi, int ystep, int h, int dx, int dy, int *k_lo, int *k_hi) {
+    int m_lo, m_hi;
+    if (ystep > 0) {
+        m_lo = yi < 0 ? -yi : 0;
+        m_hi = h - 1 - yi;
+    } else {
+        m_lo = yi >= h ? yi - h + 1 : 0;
+        m_hi = yi;
+    }
+    if (m_hi < m_lo) return 0;
+    if (dy == 0) {
+        // m stays 0
+        *k_lo = 0;
+        *k_hi = dx;
+        return m_lo == 0;
+    }
+    // m(k) >= m exactly when k * dy > (m - 1) * dx + dx / 2
+    long long e0 = dx / 2;
+    *k_lo = m_lo == 0 ? 0 : ((long long)(m_lo - 1) * dx + e0) / dy + 1;
+    *k_hi = ((long long)m_hi * dx + e0) / dy;
+    if (*k_hi > dx) *k_hi = dx;
+    return *k_lo <= *k_hi;
+}
+
+void draw_line(SDL_Surface *s, int xi, int yi, int xf, int yf, Uint32 color) {
+    char steep = abs(yf - yi) > abs(xf - xi);
+    if (steep) {
+        int swap;
+        swap = xi;
+        xi = yi;
+        yi = swap;
+        swap = xf;
+        xf = yf;
+        yf = swap;
+    }
+    if (xi > xf) {
+        int swap;
+        swap = xi;
+        xi = xf;
+        xf = swap;
+        swap = yi;
+        yi = yf;
+        yf = swap;
+    }
+    int dx = xf - xi;
+    int dy = abs(yf - yi);
+    int ystep;
+    if (yi < yf) {
+        ystep = 1;
+    } else {
+        ystep = -1;
+    }
+    // clip the whole line once: the major axis directly, the minor axis through the steps
+    // the line takes along it
+    int w = steep ? s->h : s->w;
+    int h = steep ? s->w : s->h;
+    int k_lo, k_hi;
+    if (!clip_minor_axis(yi, ystep, h, dx, dy, &k_lo, &k_hi)) return;
+    if (k_lo < -xi) k_lo = -xi;
+    if (k_hi > w - 1 - xi) k_hi = w - 1 - xi;
+    if (k_lo > k_hi) return;
+    // the error and minor position after k_lo steps
+    int m = 0;
+    if (dx > 0) {
+        long long behind = (long long)k_lo * dy - dx / 2;
+        if (behind > 0) m = (behind + dx - 1) / dx;
+    }
+    int error = dx / 2 - (long long)k_lo * dy + (long long)m * dx;
+    int x = xi + k_lo;
+    int y = yi + ystep * m;
+    int pitch = s->pitch / sizeof(Uint32);
+    Uint32 *p;
+    int major_step, minor_step;
+    if (steep) {
+        p = pixel_row(s, x) + y;
+        major_step = pitch;
+        minor_step = ystep;
+    } else {
+        p = pixel_row(s, y) + x;
+        major_step = 1;
+        minor_step = ystep * pitch;
+    }
+    int k;
+    for (k = k_lo; k <= k_hi; k++) {
+        *p = color;
+        p += major_step;
+        error -= dy;
+        if (error < 0) {
+            p += minor_step;
+            error += dx;
+        }
+    }
+}
+
+void draw_pixel(SDL_Surface *s, int x, int y, Uint32 color) {
+    pixel_row(s, y)[x] = color;
+}
+
+SDL_Color get_type_color(int type) {
+    switch (type) {
+        case 0:
+            return (SDL_Color){0, 255, 0};
+        case 1:
+            return (SDL_Color){255, 0, 255};
+        case 2:
+            return (SDL_Color){255, 91, 0};
+        case 3:
+            return (SDL_Color){0, 255, 255};
+        case 4:
+            return (SDL_Color){255, 0, 0};
+        case 5:
+            return (SDL_Color){0, 0, 255};
+        case 6:
+            return (SDL_Color){255, 255, 0};
+        case 7:
+            return (SDL_Color){255, 255, 255};
+        case 8:
+            return (SDL_Color){127, 127, 127};
+        case 9:
+            return (SDL_Color){127, 0, 192};
+    }
+    return (SDL_Color){0, 0, 0};
+}
+
+Uint32 map_type_color(int type, SDL_PixelFormat *format) {
+    switch (type) {
+        case 0:
+            return SDL_MapRGB(format, 0, 255, 0);
+        case 1:
+            return SDL_MapRGB(format, 255, 0, 255);
+        case 2:
+            return SDL_MapRGB(format, 255, 91, 0);
+        case 3:
+            return SDL_MapRGB(format, 0, 255, 255);
+        case 4:
+            return SDL_MapRGB(format, 255, 0, 0);
+        case 5:
+            return SDL_MapRGB(format, 0, 0, 255);
+        case 6:
+            return SDL_MapRGB(format, 255, 255, 0);
+        case 7:
+            return SDL_MapRGB(format, 255, 255, 255);
+        case 8:
+            return SDL_MapRGB(format, 127, 127, 127);
+        case 9:
+            return SDL_MapRGB(format, 127, 0, 192);
+    }
+    return 0;
+}
+
+Uint32 map_state_color(int state, SDL_PixelFormat *format) {
+    switch (state) {
+        case 0:
+            return 0;
+        case 1:
+            return SDL_MapRGB(format, 127, 91, 0);
+        case 2:
+            return SDL_MapRGB(format, 91, 0, 16);
+        case 3:
+            return SDL_MapRGB(format, 0, 127, 0);
+        case 4:
+            return SDL_MapRGB(format, 255, 0, 0);
+        case 5:
+            return SDL_MapRGB(format, 0, 0, 255);
+        case 6:
+            return SDL_MapRGB(format, 255, 255, 0);
+        case 7:
+            return SDL_MapRGB(format, 255, 255, 255);
+        case 8:
+            return SDL_MapRGB(format, 127, 127, 127);
+        case 9:
+            return SDL_MapRGB(format, 127, 0, 192);
+        case 10:
+            return SDL_MapRGB(format, 255, 255, 128);
+    }
+    return 0;
+}
+
+// organelle offsets of the cell being drawn, grown to fit the largest genome seen
+static int *org_locs = NULL;
+static int org_locs_allocated = 0;
+
+// a cross over the first organelle of an infected cell in the colour of the virus
+static void draw_virus_cross(SDL_Surface *s, CellSnapshot *cell, int cell_x, int cell_y, const Uint32 *type_colors) {
+    if (!cell->virus) return;
+    SDL_Rect r;
+    r.x = cell_x - energy_scale(cell->genome->organelles->r, cell->e);
+    r.y = cell_y;
+    r.w = energy_scale(cell->genome->organelles->r * 2, cell->e);
+    r.h = 1;
+    SDL_FillRect(s, &r, type_colors[cell->virus->primary_type]);
+    r.x = cell_x;
+    r.y = cell_y - energy_scale(cell->genome->organelles->r, cell->e);
+    r.w = 1;
+    r.h = energy_scale(cell->genome->organelles->r * 2, cell->e);
+    SDL_FillRect(s, &r, type_colors[cell->virus->primary_type]);
+}
+
+// cells are blitted from the sprite cache when there is one, and rasterized organelle by organelle otherwise
+void draw_cells(SDL_Surface *s, SDL_Rect view, Snapshot *snapshot, double alpha) {
+    int i, l;
+    // map the colours once per frame rather than once per organelle
+    Uint32 type_colors[NUM_TYPES];
+    Uint32 state_colors[NUM_STATE_COLORS];
+    for (i = 0; i < NUM_TYPES; i++) {
+        type_colors[i] = map_type_color(i, s->format);
+    }
+    for (i = 0; i < NUM_STATE_COLORS; i++) {
+        state_colors[i] = map_state_color(i, s->format);
+    }
+    for (i = 0; i < snapshot->num_cells; i++) {
+        CellSnapshot *cell = snapshot->cells + i;
+        // interpolate between the last two simulated positions
+        int cell_x = cell->prev_x + (cell->x - cell->prev_x) * alpha - view.x;
+        int cell_y = cell->prev_y + (cell->y - cell->prev_y) * alpha - view.y;
+        int cell_r = energy_scale(cell->genome->r, cell->e);
+        if (cell_x + cell_r < 0 || cell_x - cell_r >= view.w || cell_y + cell_r < 0 || cell_y - cell_r >= view.h) continue;
+        if (draw_cell_sprite(s, cell_x, cell_y, cell->genome, cell->e, cell->rot, cell->state,
+                    type_colors, state_colors)) {
+            draw_virus_cross(s, cell, cell_x, cell_y, type_colors);
+            continue;
+        }
+        int num_organelles = cell->genome->num_organelles;
+        if (num_organelles * 3 > org_locs_allocated) {
+            int *locs = realloc(org_locs, sizeof(*org_locs) * num_organelles * 3);
+            if (locs == NULL) continue;
+            org_locs = locs;
+            org_locs_allocated = num_organelles * 3;
+        }
+        int *org_x = org_locs;
+        int *org_y = org_locs + num_organelles;
+        int *org_r = org_locs + num_organelles * 2;
+        locate_organelles(cell->genome, cell->e, cell->rot, org_x, org_y, org_r);
+        for (l = 0; l < num_organelles; l++) {
+            if (cell->state) {
+                draw_circle(s, org_x[l] + cell_x, org_y[l] + cell_y,
+                        org_r[l], cell->state > 0 && cell->state < NUM_STATE_COLORS ? state_colors[cell->state] : 0);
+            } else {
+                draw_circle(s, org_x[l] + cell_x, org_y[l] + cell_y,
+                        org_r[l], type_colors[cell->genome->organelles[l].type]);
+            }
+        }
+        draw_virus_cross(s, cell, cell_x, cell_y, type_colors);
+    }
+    if (snapshot->selected >= 0) {
+        CellSnapshot *cell = snapshot->cells + snapshot->selected;
+        draw_circle(s, cell->prev_x + (cell->x - cell->prev_x) * alpha - view.x,
+                cell->prev_y + (cell->y - cell->prev_y) * alpha - view.y,
+                energy_scale(cell->genome->r, cell->e), SDL_MapRGB(s->format, 192, 192, 192));
+    }
+}
+
+void draw_hist(SDL_Surface *s, History *now, int mode, History *oldest, int max_cells) {
+    int i;
+    if (max_cells <= 0) {
+        // without a cap, scale to the largest population shown
+        History *point;
+        max_cells = 1;
+        for (point = now; point; point = point->past_point) {
+            if (point->num_cells > max_cells) {
+                max_cells = point->num_cells;
+            }
+        }
+    }
+    Uint32 white = SDL_MapRGB(s->format, 255, 255, 255);
+    Uint32 type_colors[NUM_TYPES];
+    for (i = 0; i < NUM_TYPES; i++) {
+        type_colors[i] = map_type_color(i, s->format);
+    }
+    while (now) {
+    	// calculate the time elapsed between oldest and now
+    	long current_elapsed = now->total_elapsed - oldest->total_elapsed;
+        if (current_elapsed < HIST_LEN * HIST_UPDATE_INTERVAL && now != oldest) {
+        	if (now->past_point) {
+        		// if past point not null, draw line from past point to now
+    			int xi = (now->past_point->total_elapsed - oldest->total_elapsed) / HIST_LEN * SCREEN_WIDTH / HIST_UPDATE_INTERVAL;
+    			int xf = (now->total_elapsed - oldest->total_elapsed) / HIST_LEN * SCREEN_WIDTH / HIST_UPDATE_INTERVAL;
+    			if (xi > xf) printf("Backward line %lu to %lu\nBackward Line %d to %d\n", now->past_point->total_elapsed - oldest->total_elapsed, now->total_elapsed - oldest->total_elapsed, xi, xf);
+                switch (mode) {
+                    case 1:
+                        draw_line(s, xi,
+                        		VIEW_HEIGHT - now->past_point->num_cells * VIEW_HEIGHT / max_cells,
+                                xf,
+                                VIEW_HEIGHT - now->num_cells * VIEW_HEIGHT / max_cells,
+                                white);
+                        break;
+                    case 2:
+                        for (i = 0; i < NUM_TYPES; i++) {
+                            draw_line(s, xi,
+                            		VIEW_HEIGHT - now->past_point->total_counts[i] * VIEW_HEIGHT / max_cells / 12,
+                                    xf,
+                                    VIEW_HEIGHT - now->total_counts[i] * VIEW_HEIGHT / max_cells / 12,
+                                    type_colors[i]);
+                        }
+                        break;
+                    case 3:
+                        for (i = 0; i < 3; i++) {
+                            draw_line(s, xi,
+                            		VIEW_HEIGHT - now->past_point->substances[i] / (SUBSTANCE_START * 3 / VIEW_HEIGHT),
+                            		xf,
+                            		VIEW_HEIGHT - now->substances[i] / (SUBSTANCE_START * 3 / VIEW_HEIGHT),
+                                    type_colors[i]);
+                        }
+                        break;
+                }
+        	}
+        	now = now->past_point; // set now to past_point even if NULL
+        } else if (oldest->future_point) {
+        	// move future point up if total duration is too long
+            oldest = oldest->future_point;
+        } else {
+        	break;
+        }
+    }
+}
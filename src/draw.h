@@ -24,11 +24,64 @@
 #include <SDL2/SDL_ttf.h>
 
 #include "constants.h"
+#include "cell.h"
+#include "graph.h"
+#include "snapshot.h"
 
+// states 1 to 10 have their own colours, see map_state_color
+#define NUM_STATE_COLORS 11
+
+// printable ASCII has glyphs in the atlas, anything else is drawn as '?'
+#define GLYPH_FIRST 32
+#define GLYPH_LAST 126
+// longer text is cut short
+#define TEXT_MAX_LEN 128
+
+// text last drawn in one place on a surface, so that it's only drawn again if it changes
+typedef struct TextSlot {
+    char text[TEXT_MAX_LEN];
+    int x, y, x_align, y_align;
+    SDL_Color color;
+    SDL_Rect rect; // area covered, filled black before anything else is drawn in the slot
+    int drawn;
+    int used; // drawn or kept since the last clear_unused_text_slots
+} TextSlot;
+
+// renders the font's glyphs once for draw_text to compose strings from; returns 0 if that fails,
+// in which case each string is rendered by SDL_ttf instead
+int create_glyph_atlas(TTF_Font *font);
+void free_glyph_atlas(void);
+// x_align and y_align of -1, 0 and 1 put x, y at the left or top, the centre, or the right or bottom
 void draw_text(SDL_Surface *s, TTF_Font *font, int x, int y, int x_align, int y_align, SDL_Color color, char *fmt, ...);
+// like draw_text, but does nothing if the slot already holds the same text, and otherwise
+// clears what it held first
+void draw_text_slot(SDL_Surface *s, TTF_Font *font, TextSlot *slot, int x, int y, int x_align, int y_align,
+        SDL_Color color, char *fmt, ...);
+// forgets what the slots hold, for when the area under them has been cleared
+void reset_text_slots(TextSlot *slots, int num_slots);
+// clears the slots that haven't been drawn in since the last call
+void clear_unused_text_slots(SDL_Surface *s, TextSlot *slots, int num_slots);
+// the drawing functions below write 32-bit pixels directly and clip to the surface.
+// circles up to max_r that are wholly on the surface are stamped from tables built here;
+// returns 0 if they could not be allocated, in which case every circle is rasterized
+int create_circle_stamps(int max_r);
+void free_circle_stamps(void);
+// row extents of the circle of radius r, or NULL if they could not be allocated: its outline
+// covers columns lo[dy] to hi[dy] either side of the centre on the rows dy above and below it,
+// with hi following lo at lo + r + 1. only valid until the next call
+int *find_circle_extents(int r);
+void fill_span(Uint32 *p, int n, Uint32 color);
 void draw_circle(SDL_Surface *s, int cx, int cy, int r, Uint32 color);
-void draw_circle_symmetry_points(SDL_Surface *s, int cx, int cy, int x, int y, Uint32 color, int check_bounds);
+void draw_filled_circle(SDL_Surface *s, int cx, int cy, int r, Uint32 color);
 void draw_line(SDL_Surface *s, int xi, int yi, int xf, int yf, Uint32 color);
+// x and y must be on the surface
 void draw_pixel(SDL_Surface *s, int x, int y, Uint32 color);
+SDL_Color get_type_color(int type);
+Uint32 map_type_color(int type, SDL_PixelFormat *format);
+Uint32 map_state_color(int state, SDL_PixelFormat *format);
+// alpha is the fraction of a step elapsed since the last one, used to interpolate positions
+void draw_cells(SDL_Surface *s, SDL_Rect view, Snapshot *snapshot, double alpha);
+// populations are drawn against max_cells, or against the largest in the history if it is 0
+void draw_hist(SDL_Surface *s, History *now, int mode, History *oldest, int max_cells);
 
 #endif
@@ -0,0 +1,121 @@
+/*  This file is part of Cellbowl.
+
+    Cellbowl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Cellbowl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Cellbowl.  If not, see <https://www.gnu.org/licenses/>. 
+    
+    © Tom Rodgers 2010-2019
+*/
+#include <math.h>
+
+#include "genome.h"
+
+// genomes are only created on the simulation thread
+static unsigned long next_genome_id = 1;
+
+Genome *create_genome(int num_organelles, Pool *pool) {
+    Genome *genome = pool_alloc(pool, sizeof(Genome) + num_organelles * sizeof(Organelle));
+    genome->refs = 1;
+    genome->id = next_genome_id++;
+    genome->num_organelles = num_organelles;
+    return genome;
+}
+
+Genome *copy_genome(Genome *src, int capacity, Pool *pool) {
+    int i;
+    Genome *genome = create_genome(capacity, pool);
+    if (genome->num_organelles > src->num_organelles) {
+        genome->num_organelles = src->num_organelles;
+    }
+    for (i = 0; i < genome->num_organelles; i++) {
+        genome->organelles[i] = src->organelles[i];
+    }
+    return genome;
+}
+
+Genome *share_genome(Genome *genome) {
+    genome->refs++;
+    return genome;
+}
+
+void release_genome(Genome *genome, Pool *pool) {
+    if (genome && !--genome->refs) {
+        pool_free(pool, genome);
+    }
+}
+
+void set_genome_variables(Genome *genome) {
+    int i;
+    for (i = 0; i < NUM_TYPES; i++) {
+        genome->type_counts[i] = 0;
+    }
+    genome->r = 0;
+    for (i = 0; i < genome->num_organelles; i++) {
+        Organelle *cur_organelle = genome->organelles + i;
+        if (i) {
+            Organelle *parent = genome->organelles + cur_organelle->parent_id;
+            cur_organelle->base_x = parent->base_x + (parent->r + cur_organelle->r) * cos(cur_organelle->angle);
+            cur_organelle->base_y = parent->base_y + (parent->r + cur_organelle->r) * sin(cur_organelle->angle);
+        } else {
+            cur_organelle->base_x = 0;
+            cur_organelle->base_y = 0;
+        }
+        int x = cur_organelle->base_x;
+        int y = cur_organelle->base_y;
+        int cur_r = ceil(sqrt(x*x + y*y)) + cur_organelle->r;
+        if (cur_r > genome->r) {
+            genome->r = cur_r;
+        }
+        genome->type_counts[cur_organelle->type] += cur_organelle->r;
+    }
+    genome->primary_type = 0;
+    for (i = 0; i < NUM_TYPES; i++) {
+        if (genome->type_counts[i] >= genome->type_counts[genome->primary_type]) {
+            genome->primary_type = i;
+        }
+    }
+    genome->weight = 1;
+    genome->weight += genome->type_counts[0] * 3 / 2;
+    genome->weight += genome->type_counts[1] * 3 / 2;
+    genome->weight += genome->type_counts[2] * 3 / 2;
+    genome->weight += genome->type_counts[3] / 5;
+    genome->weight += genome->type_counts[4] * 5 / 9;
+    genome->weight += genome->type_counts[5] * 5 / 9;
+    genome->weight += genome->type_counts[6] * 5 / 9;
+    genome->weight += genome->type_counts[7];
+    genome->weight += genome->type_counts[8] * 4 / 5;
+}
+
+void save_genome(FILE *fp, Genome *genome) {
+    int i;
+    for (i = 0; i < genome->num_organelles; i++) {
+        fprintf(fp, "%lf %d %d %d\n",
+                genome->organelles[i].angle,
+                genome->organelles[i].r,
+                genome->organelles[i].type,
+                genome->organelles[i].parent_id);
+    }
+}
+
+Genome *load_genome(FILE *fp, int num_organelles, Pool *pool) {
+    int i;
+    Genome *genome = create_genome(num_organelles, pool);
+    for (i = 0; i < num_organelles; i++) {
+        fscanf(fp, "%lf %d %d %d\n",
+                &genome->organelles[i].angle,
+                &genome->organelles[i].r,
+                &genome->organelles[i].type,
+                &genome->organelles[i].parent_id);
+    }
+    set_genome_variables(genome);
+    return genome;
+}
@@ -0,0 +1,64 @@
+/*  This file is part of Cellbowl.
+
+    Cellbowl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Cellbowl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Cellbowl.  If not, see <https://www.gnu.org/licenses/>. 
+    
+    © Tom Rodgers 2010-2019
+*/
+#ifndef GENOME_H
+#define GENOME_H
+
+#include <stdio.h>
+
+#include "constants.h"
+#include "pool.h"
+
+typedef struct Organelle {
+    // primary variables
+    double angle; // angle by which this organelle is offset from its parent
+    int r;
+    int type;
+    int parent_id; // always lower than this organelle's own index, so parents come first
+    // secondary variables
+    double base_x, base_y; // offset from the cell's centre at full energy and no rotation
+} Organelle;
+
+// the organelles of a cell or virus along with the values derived from them. a genome is
+// shared by every cell and virus descended from it without mutation, and never changes once
+// set_genome_variables has been called; a mutated child gets a copy of its own
+typedef struct Genome {
+    int refs;
+    unsigned long id; // never reused, so it still names the contents once the genome is freed
+    int num_organelles;
+    // secondary variables
+    int r; // distance of the outermost point from the centre at full energy
+    int type_counts[NUM_TYPES];
+    int primary_type;
+    int weight; // used for energy loss and movement
+    Organelle organelles[];
+} Genome;
+
+// returns a genome with one reference and room for num_organelles organelles, which the
+// caller fills in before calling set_genome_variables
+Genome *create_genome(int num_organelles, Pool *pool);
+// returns an unshared genome with room for capacity organelles holding as many of src's as fit
+Genome *copy_genome(Genome *src, int capacity, Pool *pool);
+Genome *share_genome(Genome *genome);
+// drops a reference, freeing the genome once nothing uses it
+void release_genome(Genome *genome, Pool *pool);
+// lays out the organelles at full energy to find the distance of the outermost point and the type totals
+void set_genome_variables(Genome *genome);
+void save_genome(FILE *fp, Genome *genome);
+Genome *load_genome(FILE *fp, int num_organelles, Pool *pool);
+
+#endif
@@ -115,52 +115,3 @@ void update_hist(History **now, unsigned long total_elapsed, int num_cells, int
         }
     }
 }
-
-void draw_hist(SDL_Surface *s, History *now, int mode, History *oldest) {
-    int i;
-    while (now) {
-    	// calculate the time elapsed between oldest and now
-    	long current_elapsed = now->total_elapsed - oldest->total_elapsed;
-        if (current_elapsed < HIST_LEN * HIST_UPDATE_INTERVAL && now != oldest) {
-        	if (now->past_point) {
-        		// if past point not null, draw line from past point to now
-    			int xi = (now->past_point->total_elapsed - oldest->total_elapsed) / HIST_LEN * SCREEN_WIDTH / HIST_UPDATE_INTERVAL;
-    			int xf = (now->total_elapsed - oldest->total_elapsed) / HIST_LEN * SCREEN_WIDTH / HIST_UPDATE_INTERVAL;
-    			if (xi > xf) printf("Backward line %lu to %lu\nBackward Line %d to %d\n", now->past_point->total_elapsed - oldest->total_elapsed, now->total_elapsed - oldest->total_elapsed, xi, xf);
-                switch (mode) {
-                    case 1:
-                        draw_line(s, xi,
-                        		VIEW_HEIGHT - now->past_point->num_cells * VIEW_HEIGHT / MAX_CELLS,
-                                xf,
-                                VIEW_HEIGHT - now->num_cells * VIEW_HEIGHT / MAX_CELLS,
-                                SDL_MapRGB(s->format, 255, 255, 255));
-                        break;
-                    case 2:
-                        for (i = 0; i < NUM_TYPES; i++) {
-                            draw_line(s, xi,
-                            		VIEW_HEIGHT - now->past_point->total_counts[i] * VIEW_HEIGHT / MAX_CELLS / 12,
-                                    xf,
-                                    VIEW_HEIGHT - now->total_counts[i] * VIEW_HEIGHT / MAX_CELLS / 12,
-                                    map_type_color(i, s->format));
-                        }
-                        break;
-                    case 3:
-                        for (i = 0; i < 3; i++) {
-                            draw_line(s, xi,
-                            		VIEW_HEIGHT - now->past_point->substances[i] / (SUBSTANCE_START * 3 / VIEW_HEIGHT),
-                            		xf,
-                            		VIEW_HEIGHT - now->substances[i] / (SUBSTANCE_START * 3 / VIEW_HEIGHT),
-                                    map_type_color(i, s->format));
-                        }
-                        break;
-                }
-        	}
-        	now = now->past_point; // set now to past_point even if NULL
-        } else if (oldest->future_point) {
-        	// move future point up if total duration is too long
-            oldest = oldest->future_point;
-        } else {
-        	break;
-        }
-    }
-}
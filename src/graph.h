@@ -17,11 +17,10 @@
 */
 #ifndef HIST_H
 #define HIST_H
+#include <stdio.h>
 #include <stdlib.h>
 #include <inttypes.h>
-#include <SDL2/SDL.h>
 
-#include "draw.h"
 #include "cell.h"
 
 #define HIST_UPDATE_INTERVAL 5000
@@ -41,5 +40,4 @@ void load_hist(FILE *fp, History **now, History **oldest);
 void create_hist(History **now, unsigned long total_elapsed, int num_cells, int total_counts[NUM_TYPES], unsigned long long substances[3], History **oldest);
 void free_hist(History *now, History *oldest);
 void update_hist(History **now, unsigned long total_elapsed, int num_cells, int total_counts[NUM_TYPES], unsigned long long substances[3], History **oldest);
-void draw_hist(SDL_Surface *s, History *now, int mode, History *oldest);
 #endif
@@ -0,0 +1,94 @@
+/*  This file is part of Cellbowl.
+
+    Cellbowl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Cellbowl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Cellbowl.  If not, see <https://www.gnu.org/licenses/>. 
+    
+    © Tom Rodgers 2010-2019
+*/
+#include <stdlib.h>
+
+#include "handle.h"
+
+int create_handle_table(HandleTable *table, int capacity) {
+    table->slots = malloc(sizeof(*table->slots) * capacity);
+    if (table->slots == NULL) return 0;
+    table->slots_allocated = capacity;
+    table->num_slots = 0;
+    table->first_free = -1;
+    table->next_id = 0;
+    return 1;
+}
+
+void free_handle_table(HandleTable *table) {
+    free(table->slots);
+}
+
+int grow_handle_table(HandleTable *table, int capacity) {
+    if (capacity <= table->slots_allocated) return 1;
+    HandleSlot *slots = realloc(table->slots, sizeof(*slots) * capacity);
+    if (slots == NULL) return 0;
+    table->slots = slots;
+    table->slots_allocated = capacity;
+    return 1;
+}
+
+void clear_handles(HandleTable *table) {
+    int i;
+    // keep the generations moving so that stale handles stay stale
+    table->first_free = -1;
+    for (i = table->num_slots - 1; i >= 0; i--) {
+        table->slots[i].generation++;
+        if (table->slots[i].generation == 0) {
+            table->slots[i].generation = 1;
+        }
+        table->slots[i].index = table->first_free;
+        table->first_free = i;
+    }
+    // and the ids, so that cells of the new world don't draw the random numbers of the old
+}
+
+CellHandle add_handle(HandleTable *table, int index) {
+    CellHandle handle;
+    if (table->first_free >= 0) {
+        handle.slot = table->first_free;
+        table->first_free = table->slots[handle.slot].index;
+    } else {
+        handle.slot = table->num_slots++;
+        table->slots[handle.slot].generation = 1;
+    }
+    table->slots[handle.slot].index = index;
+    handle.generation = table->slots[handle.slot].generation;
+    return handle;
+}
+
+void remove_handle(HandleTable *table, CellHandle handle) {
+    HandleSlot *slot = table->slots + handle.slot;
+    slot->generation++;
+    if (slot->generation == 0) {
+        slot->generation = 1;
+    }
+    slot->index = table->first_free;
+    table->first_free = handle.slot;
+}
+
+void move_handle(HandleTable *table, CellHandle handle, int index) {
+    table->slots[handle.slot].index = index;
+}
+
+int find_handle(const HandleTable *table, CellHandle handle) {
+    if (handle.generation == 0 || handle.slot < 0 || handle.slot >= table->num_slots ||
+            table->slots[handle.slot].generation != handle.generation) {
+        return -1;
+    }
+    return table->slots[handle.slot].index;
+}
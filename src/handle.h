@@ -0,0 +1,58 @@
+/*  This file is part of Cellbowl.
+
+    Cellbowl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Cellbowl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Cellbowl.  If not, see <https://www.gnu.org/licenses/>. 
+    
+    © Tom Rodgers 2010-2019
+*/
+#ifndef HANDLE_H
+#define HANDLE_H
+
+// refers to a cell however it is moved around the cell array, and to nothing once it has died
+typedef struct CellHandle {
+    int slot; // in the handle table
+    unsigned int generation; // of the slot when the handle was made, never 0 for a live cell
+} CellHandle;
+
+#define NO_HANDLE ((CellHandle){0, 0})
+
+typedef struct HandleSlot {
+    int index; // of the cell in the array, or of the next free slot
+    unsigned int generation; // changes whenever the cell holding the slot dies
+} HandleSlot;
+
+// where each live cell is in the array. a dead cell's slot goes to the next one born, with a new
+// generation so that handles to the dead cell no longer find anything
+typedef struct HandleTable {
+    HandleSlot *slots;
+    int num_slots, slots_allocated;
+    int first_free; // slot most recently freed, or -1
+    unsigned long long next_id; // stable id of the next cell added, never reused
+} HandleTable;
+
+// returns 0 if the table could not be allocated. capacity is the most cells alive at once
+int create_handle_table(HandleTable *table, int capacity);
+void free_handle_table(HandleTable *table);
+// returns 0 if the table could not grow, leaving it as it was
+int grow_handle_table(HandleTable *table, int capacity);
+// forgets every cell, so no handle made before finds anything. ids carry on from where they were
+void clear_handles(HandleTable *table);
+// a handle to a cell added at index. there must be room for it
+CellHandle add_handle(HandleTable *table, int index);
+void remove_handle(HandleTable *table, CellHandle handle);
+// the cell with handle has been moved to index
+void move_handle(HandleTable *table, CellHandle handle, int index);
+// index of the cell with handle, or -1 if it has died
+int find_handle(const HandleTable *table, CellHandle handle);
+
+#endif
@@ -0,0 +1,112 @@
+/*  This file is part of Cellbowl.
+
+    Cellbowl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Cellbowl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Cellbowl.  If not, see <https://www.gnu.org/licenses/>. 
+    
+    © Tom Rodgers 2010-2019
+*/
+#include <string.h>
+#include <time.h>
+
+#include "headless.h"
+
+static void print_usage(char *name) {
+    fprintf(stderr, "Usage: %s --headless [--steps N] [--step-ms MS] [--load SLOT] [--save SLOT] [--seed SEED] [--threads N]\n"
+            "       [world options]\n"
+            "  --steps N      number of simulation steps to run (default %d)\n"
+            "  --step-ms MS   simulated milliseconds per step (default %d)\n"
+            "  --load SLOT    start from the state file in SLOT instead of a new bowl\n"
+            "  --save SLOT    state file slot to write on exit, -1 to skip (default 0)\n"
+            "  --seed SEED    seed for the random number generator (default current time)\n"
+            "  --threads N    threads to step the world on (default 1)\n",
+            name, HEADLESS_DEFAULT_STEPS, DEFAULT_STEP_MS);
+    print_world_options(stderr);
+}
+
+int run_headless(int argc, char *argv[]) {
+    int i;
+    long step;
+    long steps = HEADLESS_DEFAULT_STEPS;
+    int step_ms = DEFAULT_STEP_MS;
+    int load_slot = -1;
+    int save_slot = 0;
+    unsigned int seed = time(NULL);
+    int threads = 1;
+    WorldConfig config;
+    default_world_config(&config);
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--headless")) {
+            continue;
+        } else if (!strcmp(argv[i], "--steps") && i + 1 < argc) {
+            steps = strtol(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--step-ms") && i + 1 < argc) {
+            step_ms = strtol(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--load") && i + 1 < argc) {
+            load_slot = strtol(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--save") && i + 1 < argc) {
+            save_slot = strtol(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = strtol(argv[++i], NULL, 10);
+        } else if (!parse_world_option(&config, argc, argv, &i)) {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (steps < 0 || step_ms <= 0 || threads <= 0 || load_slot > 9 || save_slot > 9 || !check_world_config(&config)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    srand(seed);
+    World *world = create_world(&config, threads, seed);
+    if (world == NULL) {
+        fprintf(stderr, "Could not allocate world\n");
+        return 1;
+    }
+    if (load_slot >= 0 && !load_state(world, load_slot)) {
+        fprintf(stderr, "Could not open state%d\n", load_slot);
+        free_world(world);
+        return 1;
+    }
+
+    unsigned long long start = get_time_ns();
+    for (step = 0; step < steps; step++) {
+        if (!step_world(world, step_ms)) {
+            fprintf(stderr, "Out of memory for collisions at step %ld\n", step);
+            free_world(world);
+            return 1;
+        }
+        record_hist(world);
+    }
+    double wall = (get_time_ns() - start) / 1e9;
+
+    printf("seed %u\n", seed);
+    printf("steps %ld\n", steps);
+    printf("threads %d\n", world->workers.num_threads);
+    printf("simulated %lu ms\n", world->total_elapsed);
+    printf("wall %.3f s\n", wall);
+    if (wall > 0) {
+        printf("steps/s %.1f\n", steps / wall);
+    }
+    printf("cells %d\n", world->num_cells);
+    printf("pool allocs %llu frees %llu slabs %llu live %llu bytes\n",
+            world->pool.allocs, world->pool.frees, world->pool.slab_allocs, world->pool.live_bytes);
+
+    if (save_slot >= 0) {
+        save_state(world, save_slot);
+    }
+    free_world(world);
+    return 0;
+}
@@ -0,0 +1,29 @@
+/*  This file is part of Cellbowl.
+
+    Cellbowl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Cellbowl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Cellbowl.  If not, see <https://www.gnu.org/licenses/>. 
+    
+    © Tom Rodgers 2010-2019
+*/
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include "world.h"
+
+#define HEADLESS_DEFAULT_STEPS 100000
+
+// steps the world without any window or rendering as fast as possible,
+// then writes the resulting state file; returns the process exit status
+int run_headless(int argc, char *argv[]);
+
+#endif
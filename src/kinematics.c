@@ -0,0 +1,346 @@
+/*  This file is part of Cellbowl.
+
+    Cellbowl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Cellbowl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Cellbowl.  If not, see <https://www.gnu.org/licenses/>. 
+    
+    © Tom Rodgers 2010-2019
+*/
+#include <string.h>
+
+#include "cell.h"
+#include "kinematics.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KINEMATICS_X86
+#include <immintrin.h>
+#endif
+
+static void select_kernel(void);
+
+int create_kinematics(Kinematics *kin, int capacity) {
+    kin->x = malloc(capacity * sizeof(*kin->x));
+    kin->y = malloc(capacity * sizeof(*kin->y));
+    kin->x_err = malloc(capacity * sizeof(*kin->x_err));
+    kin->y_err = malloc(capacity * sizeof(*kin->y_err));
+    kin->x_vel = malloc(capacity * sizeof(*kin->x_vel));
+    kin->y_vel = malloc(capacity * sizeof(*kin->y_vel));
+    kin->rot = malloc(capacity * sizeof(*kin->rot));
+    kin->rot_vel = malloc(capacity * sizeof(*kin->rot_vel));
+    kin->pause_motion = malloc(capacity * sizeof(*kin->pause_motion));
+    kin->prev_x = malloc(capacity * sizeof(*kin->prev_x));
+    kin->prev_y = malloc(capacity * sizeof(*kin->prev_y));
+    if (!(kin->x && kin->y && kin->x_err && kin->y_err && kin->x_vel && kin->y_vel &&
+                kin->rot && kin->rot_vel && kin->pause_motion && kin->prev_x && kin->prev_y)) {
+        free_kinematics(kin);
+        return 0;
+    }
+    // choose now rather than on first use, when several threads may be integrating at once
+    select_kernel();
+    return 1;
+}
+
+void free_kinematics(Kinematics *kin) {
+    free(kin->x);
+    free(kin->y);
+    free(kin->x_err);
+    free(kin->y_err);
+    free(kin->x_vel);
+    free(kin->y_vel);
+    free(kin->rot);
+    free(kin->rot_vel);
+    free(kin->pause_motion);
+    free(kin->prev_x);
+    free(kin->prev_y);
+}
+
+// leaves *array as it was if it can't grow
+static int grow_array(void **array, size_t size) {
+    void *grown = realloc(*array, size);
+    if (grown == NULL) return 0;
+    *array = grown;
+    return 1;
+}
+
+int grow_kinematics(Kinematics *kin, int capacity) {
+    int grown = 1;
+    grown &= grow_array((void **)&kin->x, capacity * sizeof(*kin->x));
+    grown &= grow_array((void **)&kin->y, capacity * sizeof(*kin->y));
+    grown &= grow_array((void **)&kin->x_err, capacity * sizeof(*kin->x_err));
+    grown &= grow_array((void **)&kin->y_err, capacity * sizeof(*kin->y_err));
+    grown &= grow_array((void **)&kin->x_vel, capacity * sizeof(*kin->x_vel));
+    grown &= grow_array((void **)&kin->y_vel, capacity * sizeof(*kin->y_vel));
+    grown &= grow_array((void **)&kin->rot, capacity * sizeof(*kin->rot));
+    grown &= grow_array((void **)&kin->rot_vel, capacity * sizeof(*kin->rot_vel));
+    grown &= grow_array((void **)&kin->pause_motion, capacity * sizeof(*kin->pause_motion));
+    grown &= grow_array((void **)&kin->prev_x, capacity * sizeof(*kin->prev_x));
+    grown &= grow_array((void **)&kin->prev_y, capacity * sizeof(*kin->prev_y));
+    return grown;
+}
+
+void reset_kinematics(Kinematics *kin, int i, int x, int y, double rot) {
+    kin->x[i] = x;
+    kin->y[i] = y;
+    kin->x_err[i] = 0;
+    kin->y_err[i] = 0;
+    kin->x_vel[i] = 0;
+    kin->y_vel[i] = 0;
+    kin->rot[i] = rot;
+    kin->rot_vel[i] = 0;
+    kin->pause_motion[i] = 0;
+    kin->prev_x[i] = x;
+    kin->prev_y[i] = y;
+}
+
+void copy_kinematics(Kinematics *kin, int dst, int src) {
+    kin->x[dst] = kin->x[src];
+    kin->y[dst] = kin->y[src];
+    kin->x_err[dst] = kin->x_err[src];
+    kin->y_err[dst] = kin->y_err[src];
+    kin->x_vel[dst] = kin->x_vel[src];
+    kin->y_vel[dst] = kin->y_vel[src];
+    kin->rot[dst] = kin->rot[src];
+    kin->rot_vel[dst] = kin->rot_vel[src];
+    kin->pause_motion[dst] = kin->pause_motion[src];
+    kin->prev_x[dst] = kin->prev_x[src];
+    kin->prev_y[dst] = kin->prev_y[src];
+}
+
+static void permute_ints(int *a, const int *order, int n, int *scratch) {
+    int i;
+    for (i = 0; i < n; i++) {
+        scratch[i] = a[order[i]];
+    }
+    memcpy(a, scratch, n * sizeof(*a));
+}
+
+static void permute_doubles(double *a, const int *order, int n, double *scratch) {
+    int i;
+    for (i = 0; i < n; i++) {
+        scratch[i] = a[order[i]];
+    }
+    memcpy(a, scratch, n * sizeof(*a));
+}
+
+void permute_kinematics(Kinematics *kin, const int *order, int n, void *scratch) {
+    permute_ints(kin->x, order, n, scratch);
+    permute_ints(kin->y, order, n, scratch);
+    permute_ints(kin->x_err, order, n, scratch);
+    permute_ints(kin->y_err, order, n, scratch);
+    permute_doubles(kin->x_vel, order, n, scratch);
+    permute_doubles(kin->y_vel, order, n, scratch);
+    permute_doubles(kin->rot, order, n, scratch);
+    permute_doubles(kin->rot_vel, order, n, scratch);
+    permute_ints(kin->pause_motion, order, n, scratch);
+    permute_ints(kin->prev_x, order, n, scratch);
+    permute_ints(kin->prev_y, order, n, scratch);
+}
+
+// displacement is the integral of the friction factor over the step, so a velocity times
+// displacement is the distance moved in thousandths of a pixel
+static void integrate_scalar(Kinematics *kin, int start, int end, double total_friction, double displacement) {
+    int i;
+    double rot_displacement = displacement / 1000;
+    for (i = start; i < end; i++) {
+        // apply movement friction
+        double last_x_vel = kin->x_vel[i];
+        kin->x_vel[i] *= total_friction;
+        int dx = last_x_vel * displacement;
+        double last_y_vel = kin->y_vel[i];
+        kin->y_vel[i] *= total_friction;
+        int dy = last_y_vel * displacement;
+
+        if (!kin->pause_motion[i]) {
+            // move cell
+            kin->x_err[i] += dx;
+            kin->x[i] += kin->x_err[i] / 1000;
+            kin->x_err[i] -= kin->x_err[i] / 1000 * 1000;
+            kin->y_err[i] += dy;
+            kin->y[i] += kin->y_err[i] / 1000;
+            kin->y_err[i] -= kin->y_err[i] / 1000 * 1000;
+
+            // apply rotational friction
+            double last_rot_vel = kin->rot_vel[i];
+            kin->rot_vel[i] *= total_friction;
+
+            // rotate cell
+            kin->rot[i] += last_rot_vel * rot_displacement;
+            if (kin->rot[i] < 0) {
+                kin->rot[i] += M_PI * 2;
+            } else if (kin->rot[i] >= M_PI * 2) {
+                kin->rot[i] -= M_PI * 2;
+            }
+        }
+    }
+}
+
+#ifdef KINEMATICS_X86
+// The vector kernels do the integer position arithmetic in doubles. The quotient of a
+// remainder by 1000 is truncated exactly, since a non-multiple of 1000 is never closer
+// than 0.001 to an integer, so the results match integrate_scalar bit for bit.
+
+__attribute__((target("sse2")))
+static void integrate_sse2(Kinematics *kin, int start, int end, double total_friction, double displacement) {
+    int i;
+    __m128d friction = _mm_set1_pd(total_friction);
+    __m128d move_factor = _mm_set1_pd(displacement);
+    __m128d rot_factor = _mm_set1_pd(displacement / 1000);
+    __m128d thousand = _mm_set1_pd(1000);
+    __m128d zero = _mm_setzero_pd();
+    __m128d two_pi = _mm_set1_pd(M_PI * 2);
+    for (i = start; i + 2 <= end; i += 2) {
+        __m128i not_paused = _mm_cmpeq_epi32(_mm_loadl_epi64((__m128i *)(kin->pause_motion + i)), _mm_setzero_si128());
+        __m128d moving = _mm_castsi128_pd(_mm_unpacklo_epi32(not_paused, not_paused));
+
+        __m128d last_x_vel = _mm_loadu_pd(kin->x_vel + i);
+        _mm_storeu_pd(kin->x_vel + i, _mm_mul_pd(last_x_vel, friction));
+        __m128d dx = _mm_cvtepi32_pd(_mm_cvttpd_epi32(_mm_mul_pd(last_x_vel, move_factor)));
+        __m128d last_y_vel = _mm_loadu_pd(kin->y_vel + i);
+        _mm_storeu_pd(kin->y_vel + i, _mm_mul_pd(last_y_vel, friction));
+        __m128d dy = _mm_cvtepi32_pd(_mm_cvttpd_epi32(_mm_mul_pd(last_y_vel, move_factor)));
+
+        __m128d last_x_err = _mm_cvtepi32_pd(_mm_loadl_epi64((__m128i *)(kin->x_err + i)));
+        __m128d x_err = _mm_add_pd(last_x_err, dx);
+        __m128d x_steps = _mm_cvtepi32_pd(_mm_cvttpd_epi32(_mm_div_pd(x_err, thousand)));
+        __m128d x = _mm_add_pd(_mm_cvtepi32_pd(_mm_loadl_epi64((__m128i *)(kin->x + i))), _mm_and_pd(moving, x_steps));
+        x_err = _mm_sub_pd(x_err, _mm_mul_pd(x_steps, thousand));
+        x_err = _mm_or_pd(_mm_and_pd(moving, x_err), _mm_andnot_pd(moving, last_x_err));
+        _mm_storel_epi64((__m128i *)(kin->x + i), _mm_cvttpd_epi32(x));
+        _mm_storel_epi64((__m128i *)(kin->x_err + i), _mm_cvttpd_epi32(x_err));
+
+        __m128d last_y_err = _mm_cvtepi32_pd(_mm_loadl_epi64((__m128i *)(kin->y_err + i)));
+        __m128d y_err = _mm_add_pd(last_y_err, dy);
+        __m128d y_steps = _mm_cvtepi32_pd(_mm_cvttpd_epi32(_mm_div_pd(y_err, thousand)));
+        __m128d y = _mm_add_pd(_mm_cvtepi32_pd(_mm_loadl_epi64((__m128i *)(kin->y + i))), _mm_and_pd(moving, y_steps));
+        y_err = _mm_sub_pd(y_err, _mm_mul_pd(y_steps, thousand));
+        y_err = _mm_or_pd(_mm_and_pd(moving, y_err), _mm_andnot_pd(moving, last_y_err));
+        _mm_storel_epi64((__m128i *)(kin->y + i), _mm_cvttpd_epi32(y));
+        _mm_storel_epi64((__m128i *)(kin->y_err + i), _mm_cvttpd_epi32(y_err));
+
+        __m128d last_rot_vel = _mm_loadu_pd(kin->rot_vel + i);
+        __m128d rot_vel = _mm_or_pd(_mm_and_pd(moving, _mm_mul_pd(last_rot_vel, friction)), _mm_andnot_pd(moving, last_rot_vel));
+        _mm_storeu_pd(kin->rot_vel + i, rot_vel);
+        __m128d last_rot = _mm_loadu_pd(kin->rot + i);
+        __m128d rot = _mm_add_pd(last_rot, _mm_mul_pd(last_rot_vel, rot_factor));
+        __m128d below = _mm_cmplt_pd(rot, zero);
+        __m128d above = _mm_andnot_pd(below, _mm_cmpge_pd(rot, two_pi));
+        rot = _mm_or_pd(_mm_and_pd(below, _mm_add_pd(rot, two_pi)), _mm_andnot_pd(below, rot));
+        rot = _mm_or_pd(_mm_and_pd(above, _mm_sub_pd(rot, two_pi)), _mm_andnot_pd(above, rot));
+        rot = _mm_or_pd(_mm_and_pd(moving, rot), _mm_andnot_pd(moving, last_rot));
+        _mm_storeu_pd(kin->rot + i, rot);
+    }
+    integrate_scalar(kin, i, end, total_friction, displacement);
+}
+
+__attribute__((target("avx2")))
+static void integrate_avx2(Kinematics *kin, int start, int end, double total_friction, double displacement) {
+    int i;
+    __m256d friction = _mm256_set1_pd(total_friction);
+    __m256d move_factor = _mm256_set1_pd(displacement);
+    __m256d rot_factor = _mm256_set1_pd(displacement / 1000);
+    __m256d thousand = _mm256_set1_pd(1000);
+    __m256d zero = _mm256_setzero_pd();
+    __m256d two_pi = _mm256_set1_pd(M_PI * 2);
+    for (i = start; i + 4 <= end; i += 4) {
+        __m256d moving = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(
+                    _mm_cmpeq_epi32(_mm_loadu_si128((__m128i *)(kin->pause_motion + i)), _mm_setzero_si128())));
+
+        __m256d last_x_vel = _mm256_loadu_pd(kin->x_vel + i);
+        _mm256_storeu_pd(kin->x_vel + i, _mm256_mul_pd(last_x_vel, friction));
+        __m256d dx = _mm256_round_pd(_mm256_mul_pd(last_x_vel, move_factor), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+        __m256d last_y_vel = _mm256_loadu_pd(kin->y_vel + i);
+        _mm256_storeu_pd(kin->y_vel + i, _mm256_mul_pd(last_y_vel, friction));
+        __m256d dy = _mm256_round_pd(_mm256_mul_pd(last_y_vel, move_factor), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+
+        __m256d last_x_err = _mm256_cvtepi32_pd(_mm_loadu_si128((__m128i *)(kin->x_err + i)));
+        __m256d x_err = _mm256_add_pd(last_x_err, dx);
+        __m256d x_steps = _mm256_round_pd(_mm256_div_pd(x_err, thousand), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+        __m256d x = _mm256_add_pd(_mm256_cvtepi32_pd(_mm_loadu_si128((__m128i *)(kin->x + i))), _mm256_and_pd(moving, x_steps));
+        x_err = _mm256_blendv_pd(last_x_err, _mm256_sub_pd(x_err, _mm256_mul_pd(x_steps, thousand)), moving);
+        _mm_storeu_si128((__m128i *)(kin->x + i), _mm256_cvttpd_epi32(x));
+        _mm_storeu_si128((__m128i *)(kin->x_err + i), _mm256_cvttpd_epi32(x_err));
+
+        __m256d last_y_err = _mm256_cvtepi32_pd(_mm_loadu_si128((__m128i *)(kin->y_err + i)));
+        __m256d y_err = _mm256_add_pd(last_y_err, dy);
+        __m256d y_steps = _mm256_round_pd(_mm256_div_pd(y_err, thousand), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+        __m256d y = _mm256_add_pd(_mm256_cvtepi32_pd(_mm_loadu_si128((__m128i *)(kin->y + i))), _mm256_and_pd(moving, y_steps));
+        y_err = _mm256_blendv_pd(last_y_err, _mm256_sub_pd(y_err, _mm256_mul_pd(y_steps, thousand)), moving);
+        _mm_storeu_si128((__m128i *)(kin->y + i), _mm256_cvttpd_epi32(y));
+        _mm_storeu_si128((__m128i *)(kin->y_err + i), _mm256_cvttpd_epi32(y_err));
+
+        __m256d last_rot_vel = _mm256_loadu_pd(kin->rot_vel + i);
+        _mm256_storeu_pd(kin->rot_vel + i, _mm256_blendv_pd(last_rot_vel, _mm256_mul_pd(last_rot_vel, friction), moving));
+        __m256d last_rot = _mm256_loadu_pd(kin->rot + i);
+        __m256d rot = _mm256_add_pd(last_rot, _mm256_mul_pd(last_rot_vel, rot_factor));
+        __m256d below = _mm256_cmp_pd(rot, zero, _CMP_LT_OQ);
+        __m256d above = _mm256_andnot_pd(below, _mm256_cmp_pd(rot, two_pi, _CMP_GE_OQ));
+        rot = _mm256_blendv_pd(rot, _mm256_add_pd(rot, two_pi), below);
+        rot = _mm256_blendv_pd(rot, _mm256_sub_pd(rot, two_pi), above);
+        _mm256_storeu_pd(kin->rot + i, _mm256_blendv_pd(last_rot, rot, moving));
+    }
+    integrate_scalar(kin, i, end, total_friction, displacement);
+}
+#endif
+
+typedef void (*IntegrateKernel)(Kinematics *kin, int start, int end, double total_friction, double displacement);
+
+static IntegrateKernel integrate_kernel = NULL;
+static const char *integrate_kernel_name = "scalar";
+
+static void select_kernel(void) {
+    integrate_kernel = integrate_scalar;
+    integrate_kernel_name = "scalar";
+#ifdef KINEMATICS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        integrate_kernel = integrate_avx2;
+        integrate_kernel_name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        integrate_kernel = integrate_sse2;
+        integrate_kernel_name = "sse2";
+    }
+#endif
+}
+
+void integrate_kinematics(Kinematics *kin, int start, int end, int elapsed) {
+    double total_friction = pow(FRICTION, elapsed);
+    integrate_kernel(kin, start, end, total_friction, (total_friction - 1) / LN_FRICTION);
+}
+
+int use_kinematics_kernel(const char *name) {
+    if (!strcmp(name, "scalar")) {
+        integrate_kernel = integrate_scalar;
+        integrate_kernel_name = "scalar";
+        return 1;
+    }
+#ifdef KINEMATICS_X86
+    __builtin_cpu_init();
+    if (!strcmp(name, "avx2") && __builtin_cpu_supports("avx2")) {
+        integrate_kernel = integrate_avx2;
+        integrate_kernel_name = "avx2";
+        return 1;
+    }
+    if (!strcmp(name, "sse2") && __builtin_cpu_supports("sse2")) {
+        integrate_kernel = integrate_sse2;
+        integrate_kernel_name = "sse2";
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+const char *kinematics_kernel_name(void) {
+    if (integrate_kernel == NULL) {
+        select_kernel();
+    }
+    return integrate_kernel_name;
+}
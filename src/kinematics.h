@@ -0,0 +1,50 @@
+/*  This file is part of Cellbowl.
+
+    Cellbowl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Cellbowl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Cellbowl.  If not, see <https://www.gnu.org/licenses/>. 
+    
+    © Tom Rodgers 2010-2019
+*/
+#ifndef KINEMATICS_H
+#define KINEMATICS_H
+
+// position and motion of every cell, one contiguous array per quantity so the
+// integration step can process several cells per instruction
+typedef struct Kinematics {
+    int *x, *y, *x_err, *y_err; // positions in pixels with remainders in thousandths
+    double *x_vel, *y_vel;
+    double *rot, *rot_vel;
+    int *pause_motion;
+    int *prev_x, *prev_y; // position at the start of the current step, for render interpolation
+} Kinematics;
+
+// returns 0 if the arrays could not be allocated
+int create_kinematics(Kinematics *kin, int capacity);
+void free_kinematics(Kinematics *kin);
+// makes room for capacity cells, keeping the first ones. returns 0 if some array could not grow
+int grow_kinematics(Kinematics *kin, int capacity);
+// places cell i at rest at (x, y) with rotation rot
+void reset_kinematics(Kinematics *kin, int i, int x, int y, double rot);
+void copy_kinematics(Kinematics *kin, int dst, int src);
+// moves cell order[i] to i for each i below n. scratch must hold n doubles
+void permute_kinematics(Kinematics *kin, const int *order, int n, void *scratch);
+// applies friction over elapsed milliseconds to the velocities of cells start to end - 1,
+// then moves and rotates each of those cells whose motion isn't paused
+void integrate_kinematics(Kinematics *kin, int start, int end, int elapsed);
+// name of the integration kernel chosen for this CPU
+const char *kinematics_kernel_name(void);
+// integrates with the kernel called name from now on, until create_kinematics chooses again.
+// returns 0 if there is no such kernel or this CPU can't run it
+int use_kinematics_kernel(const char *name);
+
+#endif
@@ -18,6 +18,7 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 #include <limits.h>
 #include <inttypes.h>
@@ -28,75 +29,123 @@
 #include "cell.h"
 #include "graph.h"
 #include "draw.h"
+#include "sprite.h"
+#include "world.h"
+#include "headless.h"
+#include "profile.h"
 #include "constants.h"
 
 #define SCROLL_SPEED 1024
 #define LIQUID_SCROLL 5
 #define NUM_HIST_MODES 3
+#define PROFILE_PANEL_WIDTH 300
+#define PROFILE_LINE_HEIGHT 14
+#define MINIMAP_MAX_WIDTH 250
+
+// the text in the HUD, in groups for the selected cell, its virus and the world
+#define HUD_SLOT_CELL 0
+#define HUD_SLOT_VIRUS (HUD_SLOT_CELL + NUM_TYPES + 4)
+#define HUD_SLOT_WORLD (HUD_SLOT_VIRUS + NUM_TYPES + 2)
+#define NUM_HUD_SLOTS (HUD_SLOT_WORLD + 8)
+
+static TextSlot hud_slots[NUM_HUD_SLOTS];
+// genomes of the selected cell and its virus drawn in the HUD, or 0
+static unsigned long shown_genome_id = 0, shown_virus_id = 0;
+
+// the minimap shows the whole area scaled by minimap_num / minimap_den, as tall as the HUD
+// unless that would make it wider than MINIMAP_MAX_WIDTH
+static int minimap_num = HUD_HEIGHT, minimap_den = AREA_HEIGHT;
+static int minimap_width, minimap_height;
+
+static int to_minimap(int x) {
+    return (long long)x * minimap_num / minimap_den;
+}
+
+static int from_minimap(int x) {
+    return (long long)x * minimap_den / minimap_num;
+}
+
+// rounded up, so nothing shrinks away
+static int minimap_size(int x) {
+    return ((long long)x * minimap_num + minimap_den - 1) / minimap_den;
+}
 
-void draw_hud(SDL_Surface *s, TTF_Font *font, SDL_Color text_color, SDL_Rect view,
-		unsigned long total_elapsed, unsigned long long substances[3],
-        Cell *cells, int num_cells, Cell *selected_cell, int selected_state,
-        int hud_update, int ms_since_last_update, int frames_since_last_update) {
+static void size_minimap(int width, int height) {
+    minimap_num = HUD_HEIGHT;
+    minimap_den = height;
+    if ((long long)width * HUD_HEIGHT > (long long)MINIMAP_MAX_WIDTH * height) {
+        minimap_num = MINIMAP_MAX_WIDTH;
+        minimap_den = width;
+    }
+    minimap_width = minimap_size(width);
+    minimap_height = minimap_size(height);
+}
+
+void draw_minimap(SDL_Surface *s, SDL_Rect view, Snapshot *snapshot, const Uint32 *type_colors,
+        const Uint32 *state_colors) {
     int i;
     SDL_Rect r;
+    CellSnapshot *selected_cell = snapshot->selected >= 0 ? snapshot->cells + snapshot->selected : NULL;
     // draw a black rectangle over the mini-map
     r.x = 0;
     r.y = 0;
-    r.w = (AREA_WIDTH * HUD_HEIGHT + AREA_HEIGHT - 1) / AREA_HEIGHT;
+    r.w = minimap_width;
     r.h = HUD_HEIGHT;
     SDL_FillRect(s, &r, SDL_MapRGB(s->format, 0, 0, 0));
     // draw grey rectangle over currently viewed area on mini-map
-    r.x = view.x * HUD_HEIGHT / AREA_HEIGHT;
-    r.y = view.y * HUD_HEIGHT / AREA_HEIGHT;
-    r.w = (view.w * HUD_HEIGHT + AREA_HEIGHT - 1) / AREA_HEIGHT;
-    r.h = (view.h * HUD_HEIGHT + AREA_HEIGHT - 1) / AREA_HEIGHT;
+    r.x = to_minimap(view.x);
+    r.y = to_minimap(view.y);
+    r.w = minimap_size(view.w);
+    r.h = minimap_size(view.h);
     SDL_FillRect(s, &r, SDL_MapRGB(s->format, 32, 32, 32));
-    // draw grey lines defining regions grid on mini-map
-    for (i = 1; i < X_REGIONS; i++) {
-        r.x = i * AREA_WIDTH / X_REGIONS * HUD_HEIGHT / AREA_HEIGHT;
-        r.y = 0;
-        r.w = 1;
-        r.h = HUD_HEIGHT;
-        SDL_FillRect(s, &r, SDL_MapRGB(s->format, 32, 32, 32));
-    }
-    for (i = 1; i < Y_REGIONS; i++) {
-        r.x = 0;
-        r.y = i * AREA_HEIGHT / Y_REGIONS * HUD_HEIGHT / AREA_HEIGHT;
-        r.w = (AREA_WIDTH * HUD_HEIGHT + AREA_HEIGHT - 1) / AREA_HEIGHT;
-        r.h = 1;
-        SDL_FillRect(s, &r, SDL_MapRGB(s->format, 32, 32, 32));
+    // draw grey lines defining the spatial hash buckets on mini-map, unless they're too close to tell apart
+    if (to_minimap(snapshot->bucket_size) >= 4) {
+        for (i = 1; i < snapshot->cols; i++) {
+            r.x = to_minimap(i * snapshot->bucket_size);
+            r.y = 0;
+            r.w = 1;
+            r.h = minimap_height;
+            SDL_FillRect(s, &r, SDL_MapRGB(s->format, 32, 32, 32));
+        }
+        for (i = 1; i < snapshot->rows; i++) {
+            r.x = 0;
+            r.y = to_minimap(i * snapshot->bucket_size);
+            r.w = minimap_width;
+            r.h = 1;
+            SDL_FillRect(s, &r, SDL_MapRGB(s->format, 32, 32, 32));
+        }
     }
     //SDL_LockSurface(s);
     // Draw circles representing cells on minimap
-    for (i = 0; i < num_cells; i++) {
-       if (cells[i].state) {
-            draw_circle(s, cells[i].x * HUD_HEIGHT / AREA_HEIGHT, cells[i].y * HUD_HEIGHT / AREA_HEIGHT,
-                    energy_scale(3, cells[i].e), map_state_color(cells[i].state, s->format));
+    for (i = 0; i < snapshot->num_cells; i++) {
+        CellSnapshot *cell = snapshot->cells + i;
+       if (cell->state) {
+            draw_circle(s, to_minimap(cell->x), to_minimap(cell->y), energy_scale(3, cell->e),
+                    cell->state > 0 && cell->state < NUM_STATE_COLORS ? state_colors[cell->state] : 0);
         } else {
-            draw_circle(s, cells[i].x * HUD_HEIGHT / AREA_HEIGHT, cells[i].y * HUD_HEIGHT / AREA_HEIGHT,
-                    energy_scale(3, cells[i].e), map_type_color(cells[i].primary_type, s->format));
+            draw_circle(s, to_minimap(cell->x), to_minimap(cell->y),
+                    energy_scale(3, cell->e), type_colors[cell->genome->primary_type]);
         }
-        if (cells[i].virus) {
+        if (cell->virus) {
         	// Draw crosses representing infecting virus
-            r.x = cells[i].x * HUD_HEIGHT / AREA_HEIGHT - energy_scale(3, cells[i].e);
-            r.y = cells[i].y * HUD_HEIGHT / AREA_HEIGHT;
-            r.w = energy_scale(6, cells[i].e);
+            r.x = to_minimap(cell->x) - energy_scale(3, cell->e);
+            r.y = to_minimap(cell->y);
+            r.w = energy_scale(6, cell->e);
             r.h = 1;
-            SDL_FillRect(s, &r, map_type_color(cells[i].virus->primary_type, s->format));
-            r.x = cells[i].x * HUD_HEIGHT / AREA_HEIGHT;
-            r.y = cells[i].y * HUD_HEIGHT / AREA_HEIGHT - energy_scale(3, cells[i].e);
+            SDL_FillRect(s, &r, type_colors[cell->virus->primary_type]);
+            r.x = to_minimap(cell->x);
+            r.y = to_minimap(cell->y) - energy_scale(3, cell->e);
             r.w = 1;
-            r.h = energy_scale(6, cells[i].e);
-            SDL_FillRect(s, &r, map_type_color(cells[i].virus->primary_type, s->format));
+            r.h = energy_scale(6, cell->e);
+            SDL_FillRect(s, &r, type_colors[cell->virus->primary_type]);
         }
     }
     if (selected_cell) {
-        draw_circle(s, selected_cell->x * HUD_HEIGHT / AREA_HEIGHT, selected_cell->y * HUD_HEIGHT / AREA_HEIGHT,
+        draw_circle(s, to_minimap(selected_cell->x), to_minimap(selected_cell->y),
                 energy_scale(3, selected_cell->e) + 1, SDL_MapRGB(s->format, 255, 255, 255));
     }
     // draw the line between mini-map and HUD
-    r.x = (AREA_WIDTH * HUD_HEIGHT + AREA_HEIGHT - 1) / AREA_HEIGHT;
+    r.x = minimap_width;
     r.y = 0;
     r.h = HUD_HEIGHT;
     r.w = 1;
@@ -105,181 +154,135 @@ void draw_hud(SDL_Surface *s, TTF_Font *font, SDL_Color text_color, SDL_Rect vie
     r.x += 1;
     r.w = 4;
     SDL_FillRect(s, &r, SDL_MapRGB(s->format, 0, 0, 0));
+}
+
+// the HUD is kept between frames: the minimap is only drawn again when redraw_minimap is set and
+// the text when hud_update is set or a second has passed. returns 1 if anything was drawn
+int draw_hud(SDL_Surface *s, TTF_Font *font, SDL_Color text_color, SDL_Rect view, Snapshot *snapshot,
+        int selected_state, int redraw_minimap, int hud_update, int ms_since_last_update, int frames_since_last_update) {
+    int i;
+    SDL_Rect r;
+    int changed = 0;
+    CellSnapshot *selected_cell = snapshot->selected >= 0 ? snapshot->cells + snapshot->selected : NULL;
+    Uint32 type_colors[NUM_TYPES];
+    Uint32 state_colors[NUM_STATE_COLORS];
+    for (i = 0; i < NUM_TYPES; i++) {
+        type_colors[i] = map_type_color(i, s->format);
+    }
+    for (i = 0; i < NUM_STATE_COLORS; i++) {
+        state_colors[i] = map_state_color(i, s->format);
+    }
+    if (redraw_minimap) {
+        draw_minimap(s, view, snapshot, type_colors, state_colors);
+        changed = 1;
+    }
     if (hud_update || ms_since_last_update > 1000) {
-    	r.x += 4;
+        r.x = minimap_width + 5;
+        r.y = 0;
         r.w = SCREEN_WIDTH - r.x;
-        SDL_FillRect(s, &r, SDL_MapRGB(s->format, 0, 0, 0));
+        r.h = HUD_HEIGHT;
+        changed = 1;
+        unsigned long genome_id = selected_cell ? selected_cell->genome->id : 0;
+        unsigned long virus_id = selected_cell && selected_cell->virus ? selected_cell->virus->id : 0;
+        int cell_display_x = ((r.x + 92) * 3 + SCREEN_WIDTH - 260) / 4;
+        int virus_display_x = (r.x + 92 + (SCREEN_WIDTH - 260) * 3) / 4;
+        if (hud_update || genome_id != shown_genome_id || virus_id != shown_virus_id) {
+            // start afresh when the drawings of the cell or its virus change
+            SDL_FillRect(s, &r, SDL_MapRGB(s->format, 0, 0, 0));
+            reset_text_slots(hud_slots, NUM_HUD_SLOTS);
+            shown_genome_id = genome_id;
+            shown_virus_id = virus_id;
+            if (selected_cell) {
+                for (i = 0; i < selected_cell->genome->num_organelles; i++) {
+                    draw_circle(s, cell_display_x + (int)selected_cell->genome->organelles[i].base_x,
+                            HUD_HEIGHT / 2 + (int)selected_cell->genome->organelles[i].base_y,
+                            selected_cell->genome->organelles[i].r, type_colors[selected_cell->genome->organelles[i].type]);
+                }
+            }
+            if (selected_cell && selected_cell->virus) {
+                for (i = 0; i < selected_cell->virus->num_organelles; i++) {
+                    draw_circle(s, virus_display_x + (int)selected_cell->virus->organelles[i].base_x,
+                            HUD_HEIGHT / 2 + (int)selected_cell->virus->organelles[i].base_y,
+                            selected_cell->virus->organelles[i].r, type_colors[selected_cell->virus->organelles[i].type]);
+                }
+            }
+        }
+        // only text that has changed since it was last drawn is drawn again
+        TextSlot *slot = hud_slots + HUD_SLOT_CELL;
         if (selected_cell) {
-            draw_text(s, font, r.x + 48, 3, 0, -1, text_color, "Cell Info");
+            draw_text_slot(s, font, slot++, r.x + 48, 3, 0, -1, text_color, "Cell Info");
             for (i = 0; i < (NUM_TYPES + 1) / 2; i++) {
-                draw_text(s, font, r.x + 6, 31 + 14*i, -1, -1, get_type_color(i), "%2d", selected_cell->type_counts[i]);
+                draw_text_slot(s, font, slot++, r.x + 6, 31 + 14*i, -1, -1, get_type_color(i), "%2d", selected_cell->genome->type_counts[i]);
             }
             for (i = (NUM_TYPES + 1) / 2; i < NUM_TYPES; i++) {
-                draw_text(s, font, r.x + 84, 31 + 14*(i - (NUM_TYPES + 1) / 2), 1, -1, get_type_color(i), "%2d", selected_cell->type_counts[i]);
-            }
-            draw_text(s, font, r.x + 6, HUD_HEIGHT - 4, -1, 1, text_color, "Energy:%5ld", selected_cell->e / 1000);
-            draw_text(s, font, r.x + 6, HUD_HEIGHT - 18, -1, 1, text_color, "Age:%8d", selected_cell->age / 1000);
-            draw_text(s, font, r.x + 6, HUD_HEIGHT - 32, -1, 1, text_color, "Weight:%5d", selected_cell->weight);
-            int cell_display_x = ((r.x + 92) * 3 + SCREEN_WIDTH - 260) / 4;
-            set_organelle_loc(selected_cell->organelles, 0, 0, -selected_cell->organelles->r, 0, 1000000); 
-            for (i = 0; i < selected_cell->num_organelles; i++) {
-                draw_circle(s, cell_display_x + selected_cell->organelles[i].x, HUD_HEIGHT / 2 + selected_cell->organelles[i].y,
-                        selected_cell->organelles[i].r, map_type_color(selected_cell->organelles[i].type, s->format));
+                draw_text_slot(s, font, slot++, r.x + 84, 31 + 14*(i - (NUM_TYPES + 1) / 2), 1, -1, get_type_color(i), "%2d", selected_cell->genome->type_counts[i]);
             }
+            draw_text_slot(s, font, slot++, r.x + 6, HUD_HEIGHT - 4, -1, 1, text_color, "Energy:%5ld", selected_cell->e / 1000);
+            draw_text_slot(s, font, slot++, r.x + 6, HUD_HEIGHT - 18, -1, 1, text_color, "Age:%8d", selected_cell->age / 1000);
+            draw_text_slot(s, font, slot++, r.x + 6, HUD_HEIGHT - 32, -1, 1, text_color, "Weight:%5d", selected_cell->genome->weight);
             if (selected_cell->virus) {
-                draw_text(s, font, SCREEN_WIDTH - 210, 3, 0, -1, text_color, "Virus Info");
+                slot = hud_slots + HUD_SLOT_VIRUS;
+                draw_text_slot(s, font, slot++, SCREEN_WIDTH - 210, 3, 0, -1, text_color, "Virus Info");
                 for (i = 0; i < (NUM_TYPES + 1) / 2; i++) {
-                    draw_text(s, font, SCREEN_WIDTH - 246, 31 + 14*i, -1, -1, get_type_color(i), "%2d", selected_cell->virus->type_counts[i]);
+                    draw_text_slot(s, font, slot++, SCREEN_WIDTH - 246, 31 + 14*i, -1, -1, get_type_color(i), "%2d", selected_cell->virus->type_counts[i]);
                 }
                 for (i = (NUM_TYPES + 1) / 2; i < NUM_TYPES; i++) {
-                    draw_text(s, font, SCREEN_WIDTH - 168, 31 + 14*(i - (NUM_TYPES + 1) / 2), 1, -1, get_type_color(i), "%2d", selected_cell->virus->type_counts[i]);
-                }
-                draw_text(s, font, SCREEN_WIDTH - 168, HUD_HEIGHT - 4, 1, 1, text_color, "Weight:%5d", selected_cell->virus->weight);
-                int virus_display_x = (r.x + 92 + (SCREEN_WIDTH - 260) * 3) / 4;
-                for (i = 0; i < selected_cell->virus->num_organelles; i++) {
-                    draw_circle(s, virus_display_x + selected_cell->virus->organelles[i].x, HUD_HEIGHT / 2 + selected_cell->virus->organelles[i].y,
-                            selected_cell->virus->organelles[i].r, map_type_color(selected_cell->virus->organelles[i].type, s->format));
+                    draw_text_slot(s, font, slot++, SCREEN_WIDTH - 168, 31 + 14*(i - (NUM_TYPES + 1) / 2), 1, -1, get_type_color(i), "%2d", selected_cell->virus->type_counts[i]);
                 }
+                draw_text_slot(s, font, slot++, SCREEN_WIDTH - 168, HUD_HEIGHT - 4, 1, 1, text_color, "Weight:%5d", selected_cell->virus->weight);
             }
         }
+        slot = hud_slots + HUD_SLOT_WORLD;
         for (i = 0; i < 3; i++) {
-            draw_text(s, font, SCREEN_WIDTH - 6, 4 + 14*i, 1, -1, get_type_color(i),
-                    "Substance %1d:%8lu", i, substances[i] / 10000);
+            draw_text_slot(s, font, slot++, SCREEN_WIDTH - 6, 4 + 14*i, 1, -1, get_type_color(i),
+                    "Substance %1d:%8lu", i, snapshot->substances[i] / 10000);
         }
-        draw_text(s, font, SCREEN_WIDTH - 6, 60, 1, -1, text_color, "Cells:%4d", num_cells);
+        draw_text_slot(s, font, slot++, SCREEN_WIDTH - 6, 60, 1, -1, text_color, "Cells:%4d", snapshot->num_cells);
         unsigned long energy_sum = 0;
         for (i = 0; i < 3; i++) {
-            energy_sum += substances[i];
+            energy_sum += snapshot->substances[i];
         }
-        for (i = 0; i < num_cells; i++) {
-            energy_sum += cells[i].e;
+        for (i = 0; i < snapshot->num_cells; i++) {
+            energy_sum += snapshot->cells[i].e;
         }
-        draw_text(s, font, SCREEN_WIDTH - 6, 74, 1, -1, text_color, "Energy Sum:%8ld", energy_sum / 1000);
-        draw_text(s, font, SCREEN_WIDTH - 6, 102, 1, -1, text_color, "Selected State:%2d", selected_state);
-        draw_text(s, font, SCREEN_WIDTH - 6, 116, 1, -1, text_color, "Time: %4lu:%02lu:%02lu",
-                total_elapsed / 3600000, total_elapsed % 3600000 / 60000, total_elapsed % 60000 / 1000);
+        draw_text_slot(s, font, slot++, SCREEN_WIDTH - 6, 74, 1, -1, text_color, "Energy Sum:%8ld", energy_sum / 1000);
+        draw_text_slot(s, font, slot++, SCREEN_WIDTH - 6, 102, 1, -1, text_color, "Selected State:%2d", selected_state);
+        draw_text_slot(s, font, slot++, SCREEN_WIDTH - 6, 116, 1, -1, text_color, "Time: %4lu:%02lu:%02lu",
+                snapshot->total_elapsed / 3600000, snapshot->total_elapsed % 3600000 / 60000,
+                snapshot->total_elapsed % 60000 / 1000);
         if (ms_since_last_update) {
-            draw_text(s, font, SCREEN_WIDTH - 6, HUD_HEIGHT - 4, 1, 1, text_color,
+            draw_text_slot(s, font, slot++, SCREEN_WIDTH - 6, HUD_HEIGHT - 4, 1, 1, text_color,
                     "FPS:%4d", 1000 * frames_since_last_update / ms_since_last_update);
         }
+        clear_unused_text_slots(s, hud_slots, NUM_HUD_SLOTS);
     }
+    return changed;
 }
 
-void assign_cells_to_regions(Cell *cells, int num_cells, Cell **cells_in_regions[][Y_REGIONS],
-        int num_cells_in_regions[][Y_REGIONS], int cells_allocated_in_regions[][Y_REGIONS]) {
-    int i, j, k;
-
-    // reset count of cells in regions
-    for (i = 0; i < X_REGIONS; i++) {
-        for (j = 0; j < Y_REGIONS; j++) {
-            num_cells_in_regions[i][j] = 0;
-        }
-    }
-
-    // count cells in regions, allocate space for cell pointers, add pointers
-    for (i = 0; i < num_cells; i++) {
-        int right_region = (cells[i].x + energy_scale(cells[i].r, cells[i].e) - 1) / (AREA_WIDTH / X_REGIONS);
-        int bottom_region = (cells[i].y + energy_scale(cells[i].r, cells[i].e) - 1) / (AREA_HEIGHT / Y_REGIONS);
-        int left_region = (cells[i].x - energy_scale(cells[i].r, cells[i].e)) / (AREA_WIDTH / X_REGIONS);
-        int top_region = (cells[i].y - energy_scale(cells[i].r, cells[i].e)) / (AREA_HEIGHT / Y_REGIONS);
-        if (right_region >= X_REGIONS) {
-            right_region = X_REGIONS - 1;
-        }
-        if (bottom_region >= Y_REGIONS) {
-            bottom_region = Y_REGIONS - 1;
-        }
-        for (j = left_region; j <= right_region; j++) {
-            for (k = top_region; k <= bottom_region; k++) {
-                num_cells_in_regions[j][k] += 1;
-                if (num_cells_in_regions[j][k] > cells_allocated_in_regions[j][k]) {
-                    cells_allocated_in_regions[j][k] += num_cells_in_regions[j][k] * 4;
-                    cells_in_regions[j][k] = realloc(cells_in_regions[j][k],
-                        cells_allocated_in_regions[j][k] * sizeof(*cells_in_regions[j][k]));
-                }
-                cells_in_regions[j][k][num_cells_in_regions[j][k] - 1] = &cells[i];
-            }
-        }
-    }
-
-    // deallocate extra space for pointers to cells in regions
-    for (i = 0; i < X_REGIONS; i++) {
-        for (j = 0; j < Y_REGIONS; j++) {
-             if (num_cells_in_regions[i][j] * 8 < cells_allocated_in_regions[i][j]) {
-                cells_allocated_in_regions[i][j] = num_cells_in_regions[i][j];
-                cells_in_regions[i][j] = realloc(cells_in_regions[i][j],
-                        cells_allocated_in_regions[i][j] * sizeof(*cells_in_regions[i][j]));
-            }
-        }
-    }
-}
-
-void save_state(int slot_num, unsigned long total_elapsed, unsigned long long substances[3], Cell cells[MAX_CELLS], int num_cells,
-        History *now) {
-    int i;
-    FILE *fp;
-    char filename[6];
-    sprintf(filename, "state%1d", slot_num);
-    fp = fopen(filename, "w");
-    fprintf(fp, "%ld\n", total_elapsed);
-    for (i = 0; i < 3; i++) {
-        fprintf(fp, "%" SCNu64 "\n", substances[i]);
-    }
-    fprintf(fp, "%d\n", num_cells);
-    for (i = 0; i < num_cells; i++) {
-        save_cell(fp, cells + i);
-        if (cells[i].virus) {
-            fprintf(fp, "1\n");
-            save_cell(fp, cells[i].virus);
-        } else {
-            fprintf(fp, "0\n");
-        }
-    }
-    save_hist(fp, now);
-    fclose(fp);
-}
-
-void load_state(int slot_num, unsigned long *total_elapsed, unsigned long long substances[3], Cell cells[MAX_CELLS], int *num_cells,
-        History **now, History **oldest) {
+#ifdef CELLBOWL_PROFILE
+void draw_profile(SDL_Surface *s, TTF_Font *font, SDL_Color text_color) {
     int i;
-    FILE *fp;
-    char filename[6];
-    sprintf(filename, "state%1d", slot_num);
-    fp = fopen(filename, "r");
-    if (fp) {
-        for (i = 0; i < *num_cells; i++) {
-            free_cell(cells + i);
-        }
-        free_hist(*now, *oldest);
-        fscanf(fp, "%lu\n", total_elapsed);
-        for (i = 0; i < 3; i++) {
-            fscanf(fp, "%" SCNu64 "\n", substances + i);
-        }
-        fscanf(fp, "%d\n", num_cells);
-        for (i = 0; i < *num_cells; i++) {
-            load_cell(fp, cells + i);
-            set_secondary_variables(cells + i);
-            int cell_infected;
-            fscanf(fp, "%d\n", &cell_infected);
-            if (cell_infected) {
-                cells[i].virus = malloc(sizeof(Cell));
-                load_cell(fp, cells[i].virus);
-                set_secondary_variables(cells[i].virus);
-            }
-        }
-        load_hist(fp, now, oldest);
-        fclose(fp);
+    SDL_FillRect(s, NULL, SDL_MapRGB(s->format, 0, 0, 0));
+    draw_text(s, font, 6, 2, -1, -1, text_color, "%-12s %9s %9s", "Phase", "Mean us", "P99 us");
+    for (i = 0; i < NUM_PROFILE_PHASES; i++) {
+        double mean_us, p99_us;
+        get_profile_stats(i, &mean_us, &p99_us);
+        draw_text(s, font, 6, 2 + PROFILE_LINE_HEIGHT * (i + 1), -1, -1, text_color, "%-12s %9.1f %9.1f",
+                profile_phase_names[i], mean_us, p99_us);
     }
 }
+#endif
 
+// anything that changes the world is sent to the simulation thread as a command
 void handle_events(int *done, int *view_x_vel, int *view_y_vel, int *view_x_goal, int *view_y_goal,
-        int *view_drag, SDL_Rect view, unsigned long *total_elapsed, unsigned long long substances[3],
-        Cell cells[MAX_CELLS], int *num_cells,
-        Cell **cells_in_regions[][Y_REGIONS], int num_cells_in_regions[][Y_REGIONS],
-        Cell **selected_cell, int *cell_drag,
-        int *hist_mode, History **now, History **oldest,
-        int *selected_state, int *hud_update) {
-    int i, j;
+        int *view_drag, SDL_Rect view, CommandQueue *commands, int *mouse_down,
+        int *hist_mode, int *selected_state, int *hud_update, int *show_profile) {
     SDL_Event event;
+    Command command;
+#ifndef CELLBOWL_PROFILE
+    // the profile panel can only be toggled when there are timers to show
+    (void)show_profile;
+#endif
     while (SDL_PollEvent(&event)) {
         switch (event.type) {
             case SDL_KEYDOWN:
@@ -297,9 +300,8 @@ void handle_events(int *done, int *view_x_vel, int *view_y_vel, int *view_x_goal
                         *view_y_vel = SCROLL_SPEED;
                         break;
                     case SDLK_DELETE:
-                        if (*selected_cell && !(*selected_cell)->state) {
-                            (*selected_cell)->state = -1;
-                        }
+                        command.type = COMMAND_DELETE;
+                        push_command(commands, command);
                         break;
                     case SDLK_j:
                         if (*hist_mode) {
@@ -356,35 +358,25 @@ void handle_events(int *done, int *view_x_vel, int *view_y_vel, int *view_x_goal
                         *hud_update = 1;
                         break;
                     case SDLK_r:
-                        for (i = 0; i < *num_cells; i++) {
-                            free_cell(cells + i);
-                        }
-                        free_hist(*now, *oldest);
-                        *total_elapsed = 0;
-                        for (i = 0; i < 3; i++) {
-                            substances[i] = SUBSTANCE_START;
-                        }
-                        *num_cells = (AREA_WIDTH / CELL_SPACE) * (AREA_HEIGHT / CELL_SPACE);
-                        add_initial_cells(cells);
-                        int total_counts[NUM_TYPES];
-                        for (i = 0; i < NUM_TYPES; i++) {
-                            total_counts[i] = 0;
-                            for (j = 0; j < *num_cells; j++) {
-                                total_counts[i] += cells[j].type_counts[i];
-                            }
-                        }
-                        create_hist(now, *total_elapsed, *num_cells, total_counts, substances, oldest);
-                        *selected_cell = NULL;
-                        *hud_update = 1;
+                        command.type = COMMAND_RESET;
+                        push_command(commands, command);
                         break;
                     case SDLK_s:
-                        save_state(*selected_state, *total_elapsed, substances, cells, *num_cells, *now);
+                        command.type = COMMAND_SAVE;
+                        command.slot = *selected_state;
+                        push_command(commands, command);
                         break;
                     case SDLK_f:
-                        load_state(*selected_state, total_elapsed, substances, cells, num_cells, now, oldest);
-                        *selected_cell = NULL;
+                        command.type = COMMAND_LOAD;
+                        command.slot = *selected_state;
+                        push_command(commands, command);
+                        break;
+#ifdef CELLBOWL_PROFILE
+                    case SDLK_p:
+                        *show_profile = !*show_profile;
                         *hud_update = 1;
                         break;
+#endif
                     case SDLK_ESCAPE:
                         *done = 1;
                         break;
@@ -412,50 +404,35 @@ void handle_events(int *done, int *view_x_vel, int *view_y_vel, int *view_x_goal
                 break;
             case SDL_MOUSEBUTTONDOWN:
                 if (event.button.y <= view.h) {
-                    int clicked_area_x = event.button.x + view.x;
-                    int clicked_area_y = event.button.y + view.y;
-                    int clicked_region_x = clicked_area_x * X_REGIONS / AREA_WIDTH;
-                    int clicked_region_y = clicked_area_y * Y_REGIONS / AREA_HEIGHT;
-                    int found_one = 0;
-                    int i;
-                    for (i = 0; i < num_cells_in_regions[clicked_region_x][clicked_region_y]; i++) {
-                        int dx = clicked_area_x - cells_in_regions[clicked_region_x][clicked_region_y][i]->x;
-                        int dy = clicked_area_y - cells_in_regions[clicked_region_x][clicked_region_y][i]->y;
-                        int cell_r = energy_scale(cells_in_regions[clicked_region_x][clicked_region_y][i]->r,
-                                cells_in_regions[clicked_region_x][clicked_region_y][i]->e);
-                        if (dx * dx + dy * dy < cell_r * cell_r) {
-                            if (*selected_cell == cells_in_regions[clicked_region_x][clicked_region_y][i]) {
-                                *cell_drag = 1;
-                                (*selected_cell)->pause_motion = 1;
-                            }
-                            *selected_cell = cells_in_regions[clicked_region_x][clicked_region_y][i];
-                            found_one = 1;
-                        }
-                    }
-                    if (!found_one) {
-                        *selected_cell = NULL;
-                    }
-                    *hud_update = 1;
-                } else if (event.button.x < (AREA_WIDTH * HUD_HEIGHT + AREA_HEIGHT - 1) / AREA_HEIGHT) {
-                    *view_x_goal = event.button.x * AREA_HEIGHT / HUD_HEIGHT;
-                    *view_y_goal = (event.button.y - view.h) * AREA_HEIGHT / HUD_HEIGHT;
+                    command.type = COMMAND_SELECT;
+                    command.x = event.button.x + view.x;
+                    command.y = event.button.y + view.y;
+                    push_command(commands, command);
+                    *mouse_down = 1;
+                } else if (event.button.x < minimap_width) {
+                    *view_x_goal = from_minimap(event.button.x);
+                    *view_y_goal = from_minimap(event.button.y - view.h);
                     *view_drag = 1;
                 }
                 break;
             case SDL_MOUSEMOTION:
-                if (*selected_cell && *cell_drag && event.motion.y <= view.h) {
-                    (*selected_cell)->x = event.motion.x + view.x;
-                    (*selected_cell)->y = event.motion.y + view.y;
-                } else if (*view_drag && event.motion.x < (AREA_WIDTH * HUD_HEIGHT + AREA_HEIGHT - 1) / AREA_HEIGHT &&
+                if (*mouse_down && event.motion.y <= view.h) {
+                    // only does anything if the press started dragging the selected cell
+                    command.type = COMMAND_DRAG;
+                    command.x = event.motion.x + view.x;
+                    command.y = event.motion.y + view.y;
+                    push_command(commands, command);
+                } else if (*view_drag && event.motion.x < minimap_width &&
                         event.motion.y > view.h) {
-                    *view_x_goal = event.motion.x * AREA_HEIGHT / HUD_HEIGHT;
-                    *view_y_goal = (event.motion.y - view.h) * AREA_HEIGHT / HUD_HEIGHT;
+                    *view_x_goal = from_minimap(event.motion.x);
+                    *view_y_goal = from_minimap(event.motion.y - view.h);
                 }
                 break;
             case SDL_MOUSEBUTTONUP:
-                *cell_drag = 0;
-                if (*selected_cell) {
-                    (*selected_cell)->pause_motion = 0;
+                if (*mouse_down) {
+                    command.type = COMMAND_RELEASE;
+                    push_command(commands, command);
+                    *mouse_down = 0;
                 }
                 *view_drag = 0;
                 break;
@@ -466,8 +443,234 @@ void handle_events(int *done, int *view_x_vel, int *view_y_vel, int *view_x_goal
     }
 }
 
+// shared between the render loop and the simulation thread, which owns the world
+typedef struct Simulation {
+    World *world;
+    SnapshotBuffer *snapshots;
+    CommandQueue commands;
+    int step_ms;
+    int max_steps_per_frame;
+    SDL_atomic_t quit;
+    // only used by the simulation thread
+    CellHandle selected;
+    int cell_drag;
+    unsigned long hud_version;
+    unsigned long hist_epoch; // counts the times the history has been replaced
+} Simulation;
+
+void apply_command(Simulation *sim, Command *command) {
+    World *world = sim->world;
+    int selected = find_handle(&world->handles, sim->selected);
+    switch (command->type) {
+        case COMMAND_SELECT:
+            {
+                SpatialHash *hash = &world->hash;
+                int left_col, top_row, right_col, bottom_row;
+                get_spatial_range(hash, command->x, command->y, command->x, command->y,
+                        &left_col, &top_row, &right_col, &bottom_row);
+                int found_one = 0;
+                int i, j, k;
+                for (j = top_row; j <= bottom_row; j++) {
+                    for (i = left_col; i <= right_col; i++) {
+                        int b = j * hash->cols + i;
+                        for (k = hash->starts[b]; k < hash->starts[b + 1]; k++) {
+                            int cell_id = hash->entries[k];
+                            Cell *cell = world->cells + cell_id;
+                            int dx = command->x - world->kin.x[cell_id];
+                            int dy = command->y - world->kin.y[cell_id];
+                            int cell_r = energy_scale(cell->genome->r, cell->e);
+                            if (dx * dx + dy * dy < cell_r * cell_r) {
+                                if (selected == cell_id) {
+                                    sim->cell_drag = 1;
+                                    world->kin.pause_motion[cell_id] = 1;
+                                }
+                                sim->selected = cell->handle;
+                                found_one = 1;
+                            }
+                        }
+                    }
+                }
+                if (!found_one) {
+                    sim->selected = NO_HANDLE;
+                }
+                sim->hud_version++;
+            }
+            break;
+        case COMMAND_DRAG:
+            if (selected >= 0 && sim->cell_drag) {
+                world->kin.x[selected] = command->x;
+                world->kin.y[selected] = command->y;
+                world->kin.prev_x[selected] = world->kin.x[selected];
+                world->kin.prev_y[selected] = world->kin.y[selected];
+            }
+            break;
+        case COMMAND_RELEASE:
+            sim->cell_drag = 0;
+            if (selected >= 0) {
+                world->kin.pause_motion[selected] = 0;
+            }
+            break;
+        case COMMAND_DELETE:
+            if (selected >= 0 && !world->cells[selected].state) {
+                world->cells[selected].state = -1;
+            }
+            break;
+        case COMMAND_RESET:
+            reset_world(world);
+            hash_cells(world);
+            sim->selected = NO_HANDLE;
+            sim->cell_drag = 0;
+            sim->hud_version++;
+            sim->hist_epoch++;
+            break;
+        case COMMAND_SAVE:
+            save_state(world, command->slot);
+            break;
+        case COMMAND_LOAD:
+            if (load_state(world, command->slot)) {
+                hash_cells(world);
+                sim->selected = NO_HANDLE;
+                sim->cell_drag = 0;
+                sim->hist_epoch++;
+            }
+            sim->hud_version++;
+            break;
+    }
+}
+
+// steps the world in fixed steps of step_ms, as many as real time allows, and publishes a snapshot
+// after every change for the render loop to draw interpolated between the last two steps
+int run_simulation(void *data) {
+    Simulation *sim = data;
+    World *world = sim->world;
+    Uint64 counter_freq = SDL_GetPerformanceFrequency();
+    Uint64 step_ticks = counter_freq * sim->step_ms / 1000;
+    Uint64 last_counter = SDL_GetPerformanceCounter();
+    Uint64 accumulator = 0;
+    unsigned long long step_time_ns = get_time_ns();
+    int changed = 1;
+    int limit_hit = 0; // only reported when the population first reaches the cap
+    while (!SDL_AtomicGet(&sim->quit)) {
+        Command command;
+        while (pop_command(&sim->commands, &command)) {
+            apply_command(sim, &command);
+            changed = 1;
+        }
+
+        Uint64 cur_counter = SDL_GetPerformanceCounter();
+        accumulator += cur_counter - last_counter;
+        last_counter = cur_counter;
+        int steps = 0;
+        while (accumulator >= step_ticks && steps < sim->max_steps_per_frame) {
+            if (!step_world(world, sim->step_ms)) {
+                fprintf(stderr, "Out of memory for collisions, stopping\n");
+                SDL_AtomicSet(&sim->quit, 1);
+                return 1;
+            }
+            record_hist(world);
+            if (sim->selected.generation && find_handle(&world->handles, sim->selected) < 0) {
+                // the selected cell died
+                sim->selected = NO_HANDLE;
+                sim->cell_drag = 0;
+                sim->hud_version++;
+            }
+            accumulator -= step_ticks;
+            steps++;
+        }
+        if (accumulator >= step_ticks) {
+            // the simulation can't keep up, so let it fall behind real time instead of
+            // taking ever more steps at once
+            accumulator %= step_ticks;
+        }
+        if (steps) {
+            // when the last step would have been taken had it kept exactly to real time
+            step_time_ns = get_time_ns() - accumulator * 1000000000ull / counter_freq;
+            changed = 1;
+        }
+
+        if (changed) {
+            Snapshot *snapshot = begin_snapshot(sim->snapshots, &world->pool);
+            fill_snapshot(snapshot, world, sim->selected, sim->hud_version, sim->hist_epoch, step_time_ns);
+            publish_snapshot(sim->snapshots);
+            if (world->num_cells < world->config.max_cells) {
+                limit_hit = 0;
+            } else if (world->config.max_cells && !limit_hit) {
+                printf("Cell Limit Hit\n");
+                limit_hit = 1;
+            }
+            changed = 0;
+        } else {
+            SDL_Delay(1);
+        }
+    }
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
-    int i, j;
+    int i;
+    int step_ms = DEFAULT_STEP_MS;
+    int max_steps_per_frame = MAX_STEPS_PER_FRAME;
+    char *profile_csv = NULL;
+    int threads = 1;
+    int stamp_max_r = CIRCLE_STAMP_MAX_R;
+    unsigned long minimap_ms = DEFAULT_MINIMAP_MS;
+    long sprite_budget = SPRITE_CACHE_BUDGET;
+    WorldConfig config;
+    default_world_config(&config);
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--headless")) {
+            return run_headless(argc, argv);
+        }
+    }
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--step-ms") && i + 1 < argc) {
+            step_ms = strtol(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--max-steps") && i + 1 < argc) {
+            max_steps_per_frame = strtol(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--profile-csv") && i + 1 < argc) {
+            profile_csv = argv[++i];
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = strtol(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--stamp-max-r") && i + 1 < argc) {
+            stamp_max_r = strtol(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--minimap-ms") && i + 1 < argc) {
+            minimap_ms = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--sprite-kb") && i + 1 < argc) {
+            sprite_budget = strtol(argv[++i], NULL, 10) * 1024;
+        } else if (!parse_world_option(&config, argc, argv, &i)) {
+            fprintf(stderr, "Usage: %s [--step-ms MS] [--max-steps N] [--threads N] [--stamp-max-r R] [--sprite-kb KB]\n"
+                    "       [--minimap-ms MS] [--profile-csv FILE] [world options]\n"
+                    "       %s --headless [options]\n"
+                    "World options:\n", argv[0], argv[0]);
+            print_world_options(stderr);
+            return 1;
+        }
+    }
+    if (!check_world_config(&config)) {
+        fprintf(stderr, "Bowl and bucket sizes must be positive and cell counts not negative\n");
+        return 1;
+    }
+    // the view never leaves the area
+    if (config.width <= SCREEN_WIDTH || config.height <= VIEW_HEIGHT) {
+        fprintf(stderr, "The bowl must be larger than the %dx%d view\n", SCREEN_WIDTH, VIEW_HEIGHT);
+        return 1;
+    }
+    size_minimap(config.width, config.height);
+    if (step_ms <= 0 || max_steps_per_frame <= 0 || threads <= 0) {
+        fprintf(stderr, "Step size, steps per frame and threads must be positive\n");
+        return 1;
+    }
+    if (profile_csv) {
+#ifdef CELLBOWL_PROFILE
+        if (!open_profile_trace(profile_csv)) {
+            fprintf(stderr, "Could not open %s\n", profile_csv);
+            return 1;
+        }
+#else
+        fprintf(stderr, "Built without CELLBOWL_PROFILE, --profile-csv is unavailable\n");
+        return 1;
+#endif
+    }
 
     SDL_Init(SDL_INIT_VIDEO);
     SDL_Window *window = SDL_CreateWindow("Cell Bowl",
@@ -485,69 +688,85 @@ int main(int argc, char *argv[]) {
     SDL_Rect view; // rectangle representing current position
     view.w = SCREEN_WIDTH;
     view.h = SCREEN_HEIGHT - HUD_HEIGHT;
-    view.x = AREA_WIDTH / 2 - view.w / 2;
-    view.y = AREA_HEIGHT / 2 - view.h / 2;
+    view.x = config.width / 2 - view.w / 2;
+    view.y = config.height / 2 - view.h / 2;
     int view_x_vel = 0;
     int view_y_vel = 0;
-    int view_x_goal = AREA_WIDTH / 2;
-    int view_y_goal = AREA_HEIGHT / 2;
+    int view_x_goal = config.width / 2;
+    int view_y_goal = config.height / 2;
     int view_drag = 0;
+    if (!create_circle_stamps(stamp_max_r)) {
+        fprintf(stderr, "Could not allocate circle stamps, drawing without them\n");
+    }
+    if (sprite_budget < 0 || !create_sprite_cache(sprite_budget)) {
+        fprintf(stderr, "Could not create the sprite cache, drawing cells without it\n");
+    }
     TTF_Init();
     TTF_Font *font;
     font = TTF_OpenFont("Terminus.ttf", 14);
+    if (font == NULL || !create_glyph_atlas(font)) {
+        fprintf(stderr, "Could not build the glyph atlas, rendering text a string at a time\n");
+    }
     SDL_Color text_color = {192, 192, 192};
 
     int selected_state = 0;
-    unsigned long total_elapsed = 0;
-
-    srand(time(NULL));
 
-    unsigned long long substances[3];
-    for (i = 0; i < 3; i++) {
-        substances[i] = SUBSTANCE_START;
-    }
+    unsigned int seed = time(NULL);
+    srand(seed);
 
-    int num_cells = (AREA_WIDTH / CELL_SPACE) * (AREA_HEIGHT / CELL_SPACE);
-    Cell cells[MAX_CELLS];
-    add_initial_cells(cells);
-    Cell **cells_in_regions[X_REGIONS][Y_REGIONS];
-    int num_cells_in_regions[X_REGIONS][Y_REGIONS];
-    int cells_allocated_in_regions[X_REGIONS][Y_REGIONS];
-    for (i = 0; i < X_REGIONS; i++) {
-        for (j = 0; j < Y_REGIONS; j++) {
-            cells_allocated_in_regions[i][j] = num_cells / (X_REGIONS * Y_REGIONS) * 3;
-            cells_in_regions[i][j] = malloc(sizeof(*cells_in_regions[i][j]) * cells_allocated_in_regions[i][j]);
-        }
+    World *world = create_world(&config, threads, seed);
+    if (world == NULL) {
+        fprintf(stderr, "Could not allocate world\n");
+        return 1;
     }
-    Cell *selected_cell = NULL;
-    int cell_drag = 0;
+    hash_cells(world);
+
+    // the world belongs to the simulation thread from here until it is joined
+    Simulation sim;
+    sim.world = world;
+    sim.snapshots = malloc(sizeof(SnapshotBuffer));
+    init_snapshot_buffer(sim.snapshots);
+    init_command_queue(&sim.commands);
+    sim.step_ms = step_ms;
+    sim.max_steps_per_frame = max_steps_per_frame;
+    SDL_AtomicSet(&sim.quit, 0);
+    sim.selected = NO_HANDLE;
+    sim.cell_drag = 0;
+    sim.hud_version = 0;
+    sim.hist_epoch = 0;
+    SDL_Thread *sim_thread = SDL_CreateThread(run_simulation, "simulation", &sim);
+    int mouse_down = 0;
+    unsigned long hud_version = 0;
+    SDL_Rect minimap_view = view;
+    unsigned long minimap_elapsed = 0;
 
     SDL_Surface *hud = SDL_CreateRGBSurface(0, SCREEN_WIDTH, HUD_HEIGHT, SCREEN_DEPTH,
     		0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
 
-    History *now, *oldest;
-    int total_counts[NUM_TYPES];
-    for (i = 0; i < NUM_TYPES; i++) {
-        total_counts[i] = 0;
-        for (j = 0; j < num_cells; j++) {
-            total_counts[i] += cells[j].type_counts[i];
-        }
-    }
-    create_hist(&now, total_elapsed, num_cells, total_counts, substances, &oldest);
     int hist_mode = 0;
-
-    // measure time elapsed since last update to keep movement smooth
-    int cur_elapsed, last_elapsed, hud_update, ms_since_last_update, frames_since_last_update, done;
-    last_elapsed = SDL_GetTicks();
-    cur_elapsed = last_elapsed;
+    int show_profile = 0;
+#ifdef CELLBOWL_PROFILE
+    SDL_Surface *profile_panel = SDL_CreateRGBSurface(0, PROFILE_PANEL_WIDTH, PROFILE_LINE_HEIGHT * (NUM_PROFILE_PHASES + 1) + 4,
+            SCREEN_DEPTH, 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
+#endif
+
+    // frames are drawn from the latest snapshot at their own rate, interpolated between its
+    // last two steps by how much real time has passed since it was taken
+    Uint64 counter_freq = SDL_GetPerformanceFrequency();
+    Uint64 last_counter = SDL_GetPerformanceCounter();
+    Uint64 ticks_since_last_update = 0;
+    int cur_elapsed, hud_update, ms_since_last_update, frames_since_last_update, done;
+    cur_elapsed = 0;
     hud_update = 1;
     ms_since_last_update = 0;
     frames_since_last_update = 0;
     done = 0;
-    while (!done) {
-        handle_events(&done, &view_x_vel, &view_y_vel, &view_x_goal, &view_y_goal, &view_drag, view, &total_elapsed, substances,
-                cells, &num_cells, cells_in_regions, num_cells_in_regions, &selected_cell, &cell_drag,
-                &hist_mode, &now, &oldest, &selected_state, &hud_update);
+    // the simulation stops by itself if it runs out of memory
+    while (!done && !SDL_AtomicGet(&sim.quit)) {
+        PROFILE_BEGIN(PHASE_EVENTS);
+        handle_events(&done, &view_x_vel, &view_y_vel, &view_x_goal, &view_y_goal, &view_drag, view,
+                &sim.commands, &mouse_down, &hist_mode, &selected_state, &hud_update, &show_profile);
+        PROFILE_END(PHASE_EVENTS);
         view.x += (view_x_goal - (view.x + view.w / 2)) / LIQUID_SCROLL;
         view_x_goal += view_x_vel * cur_elapsed / 1000;
         view.y += (view_y_goal - (view.y + view.h / 2)) / LIQUID_SCROLL;
@@ -555,30 +774,37 @@ int main(int argc, char *argv[]) {
         if (view.x < 0) {
             view.x = 0;
             view_x_goal = view.w / 2;
-        } else if (view.x + view.w >= AREA_WIDTH) {
-            view.x = AREA_WIDTH - view.w - 1;
-            view_x_goal = AREA_WIDTH - view.w / 2 - 1;
+        } else if (view.x + view.w >= config.width) {
+            view.x = config.width - view.w - 1;
+            view_x_goal = config.width - view.w / 2 - 1;
         }
         if (view.y < 0) {
             view.y = 0;
             view_y_goal = view.h / 2;
-        } else if (view.y + view.h >= AREA_HEIGHT) {
-            view.y = AREA_HEIGHT - view.h - 1;
-            view_y_goal = AREA_HEIGHT - view.h / 2 - 1;
+        } else if (view.y + view.h >= config.height) {
+            view.y = config.height - view.h - 1;
+            view_y_goal = config.height - view.h / 2 - 1;
         }
 
-        cur_elapsed = SDL_GetTicks() - last_elapsed;
-        last_elapsed = SDL_GetTicks();
-        ms_since_last_update += cur_elapsed;
+        Uint64 cur_counter = SDL_GetPerformanceCounter();
+        Uint64 frame_ticks = cur_counter - last_counter;
+        last_counter = cur_counter;
+        cur_elapsed = frame_ticks * 1000 / counter_freq;
+        ticks_since_last_update += frame_ticks;
+        ms_since_last_update = ticks_since_last_update * 1000 / counter_freq;
         frames_since_last_update++;
-        if (total_elapsed + cur_elapsed > ULONG_MAX) {
-            total_elapsed -= ULONG_MAX;
-        }
-        total_elapsed += cur_elapsed;
 
-        assign_cells_to_regions(cells, num_cells, cells_in_regions, num_cells_in_regions, cells_allocated_in_regions);
-
-        adjust_cells(cells, num_cells, cells_in_regions, num_cells_in_regions, substances, cur_elapsed);
+        Snapshot *snapshot = latest_snapshot(sim.snapshots);
+        if (snapshot->hud_version != hud_version) {
+            hud_version = snapshot->hud_version;
+            hud_update = 1;
+        }
+        double alpha = (double)(get_time_ns() - snapshot->step_time_ns) / (step_ms * 1000000.0);
+        if (alpha < 0) {
+            alpha = 0;
+        } else if (alpha > 1) {
+            alpha = 1;
+        }
 
         SDL_Rect r;
         r.x = 0;
@@ -588,60 +814,85 @@ int main(int argc, char *argv[]) {
         SDL_FillRect(screen, &r, 0); // draw black on the screen
         
         if (!hist_mode) {
-            draw_cells(screen, view, cells_in_regions, num_cells_in_regions, selected_cell);
+            PROFILE_BEGIN(PHASE_DRAW_CELLS);
+            draw_cells(screen, view, snapshot, alpha);
+            PROFILE_END(PHASE_DRAW_CELLS);
         } else {
-            draw_hist(screen, now, hist_mode, oldest);
+            PROFILE_BEGIN(PHASE_DRAW_HIST);
+            if (snapshot->hist_now) {
+                draw_hist(screen, snapshot->hist_now, hist_mode, snapshot->hist_oldest, snapshot->max_cells);
+            }
+            PROFILE_END(PHASE_DRAW_HIST);
         }
 
-        draw_hud(hud, font, text_color, view, total_elapsed, substances, cells, num_cells, selected_cell,
-                selected_state, hud_update, ms_since_last_update, frames_since_last_update);
-        hud_update = 0;
-
-
-        census_cells(cells, &num_cells, &selected_cell, substances, &hud_update);
-
-
-        if (num_cells == MAX_CELLS) {
-            printf("Cell Limit Hit\n");
+        PROFILE_BEGIN(PHASE_DRAW_HUD);
+        // the minimap moves with the view and the selection, and otherwise only every minimap_ms
+        // of simulated time
+        int redraw_minimap = hud_update || view.x != minimap_view.x || view.y != minimap_view.y ||
+                snapshot->total_elapsed < minimap_elapsed || snapshot->total_elapsed - minimap_elapsed >= minimap_ms;
+        if (redraw_minimap) {
+            minimap_view = view;
+            minimap_elapsed = snapshot->total_elapsed;
+        }
+        int hud_changed = draw_hud(hud, font, text_color, view, snapshot, selected_state, redraw_minimap,
+                hud_update, ms_since_last_update, frames_since_last_update);
+#ifdef CELLBOWL_PROFILE
+        if (show_profile) {
+            // the panel only changes as often as the rest of the HUD text
+            if (hud_update || ms_since_last_update > 1000) {
+                draw_profile(profile_panel, font, text_color);
+            }
+            SDL_BlitSurface(profile_panel, NULL, screen, NULL);
         }
+#endif
+        PROFILE_END(PHASE_DRAW_HUD);
+        hud_update = 0;
 
+        // nothing else is drawn over the HUD on the screen, so it stays as it was until the HUD changes
         r.y = view.h;
-        SDL_BlitSurface(hud, NULL, screen, &r);
+        if (hud_changed) {
+            SDL_BlitSurface(hud, NULL, screen, &r);
+        }
 
         r.y -= 1;
         r.h = 1;
         SDL_FillRect(screen, &r, SDL_MapRGB(screen->format, 83, 93, 108));
 
         if (ms_since_last_update > 1000) {
+            ticks_since_last_update = 0;
             ms_since_last_update = 0;
             frames_since_last_update = 0;
-            for (i = 0; i < NUM_TYPES; i++) {
-                total_counts[i] = 0;
-                for (j = 0; j < num_cells; j++) {
-                    total_counts[i] += cells[j].type_counts[i];
-                }
-            }
-            update_hist(&now, total_elapsed, num_cells, total_counts, substances, &oldest);
         }
-        SDL_UpdateTexture(texture, NULL, screen->pixels, screen->pitch);
+        PROFILE_BEGIN(PHASE_PRESENT);
+        if (hud_changed) {
+            SDL_UpdateTexture(texture, NULL, screen->pixels, screen->pitch);
+        } else {
+            SDL_Rect view_area = {0, 0, SCREEN_WIDTH, view.h};
+            SDL_UpdateTexture(texture, &view_area, screen->pixels, screen->pitch);
+        }
         SDL_RenderClear(renderer);
         SDL_RenderCopy(renderer, texture, NULL, NULL);
         SDL_RenderPresent(renderer);
+        PROFILE_END(PHASE_PRESENT);
+        PROFILE_END_FRAME();
         SDL_Delay(7);
     }
 
-    save_state(0, total_elapsed, substances, cells, num_cells, now);
+    SDL_AtomicSet(&sim.quit, 1);
+    SDL_WaitThread(sim_thread, NULL);
+    save_state(world, 0);
 
     // free memory mainly for valgrind
-    free_hist(now, oldest);
-    for (i = 0; i < X_REGIONS; i++) {
-        for (j = 0; j < Y_REGIONS; j++) {
-            free(cells_in_regions[i][j]);
-        }
-    }
-    for (i = 0; i < num_cells; i++) {
-        free_cell(cells + i);
-    }
+    free_snapshot_buffer(sim.snapshots, &world->pool);
+    free(sim.snapshots);
+    free_world(world);
+#ifdef CELLBOWL_PROFILE
+    close_profile_trace();
+    SDL_FreeSurface(profile_panel);
+#endif
+    free_sprite_cache();
+    free_circle_stamps();
+    free_glyph_atlas();
     TTF_CloseFont(font);
     TTF_Quit();
     SDL_FreeSurface(hud);
@@ -0,0 +1,129 @@
+/*  This file is part of Cellbowl.
+
+    Cellbowl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Cellbowl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Cellbowl.  If not, see <https://www.gnu.org/licenses/>. 
+    
+    © Tom Rodgers 2010-2019
+*/
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pool.h"
+
+// sits in front of each block to remember how big it is
+typedef union PoolHeader {
+    size_t size; // header included; bigger than the largest class for blocks from malloc
+    double align;
+    void *align_ptr;
+} PoolHeader;
+
+// a free block reuses its own memory as the link to the next one
+typedef struct PoolFreeBlock {
+    struct PoolFreeBlock *next;
+} PoolFreeBlock;
+
+void init_pool(Pool *pool) {
+    int i;
+    for (i = 0; i < POOL_NUM_CLASSES; i++) {
+        pool->free_lists[i] = NULL;
+    }
+    pool->slabs = NULL;
+    pool->allocs = 0;
+    pool->frees = 0;
+    pool->slab_allocs = 0;
+    pool->large_allocs = 0;
+    pool->live_bytes = 0;
+}
+
+void free_pool(Pool *pool) {
+    while (pool->slabs) {
+        void *next = *(void **)pool->slabs;
+        free(pool->slabs);
+        pool->slabs = next;
+    }
+    init_pool(pool);
+}
+
+static size_t get_class_size(int size_class) {
+    size_t size = (size_t)1 << (size_class / 2 + POOL_MIN_SHIFT);
+    return size_class % 2 ? size + size / 2 : size;
+}
+
+// smallest class that fits size bytes, or POOL_NUM_CLASSES if none does
+static int find_size_class(size_t size) {
+    int size_class = 0;
+    while (size_class < POOL_NUM_CLASSES && get_class_size(size_class) < size) {
+        size_class++;
+    }
+    return size_class;
+}
+
+// carves a new slab into blocks of one size class and puts them on its free list
+static int add_slab(Pool *pool, int size_class) {
+    size_t block_size = get_class_size(size_class);
+    char *slab = malloc(sizeof(PoolHeader) + POOL_SLAB_SIZE);
+    if (slab == NULL) return 0;
+    *(void **)slab = pool->slabs;
+    pool->slabs = slab;
+    pool->slab_allocs++;
+    char *block;
+    for (block = slab + sizeof(PoolHeader); block + block_size <= slab + sizeof(PoolHeader) + POOL_SLAB_SIZE;
+            block += block_size) {
+        PoolFreeBlock *free_block = (PoolFreeBlock *)block;
+        free_block->next = pool->free_lists[size_class];
+        pool->free_lists[size_class] = free_block;
+    }
+    return 1;
+}
+
+static void fail_pool_alloc(size_t size) {
+    fprintf(stderr, "Out of memory for a %zu byte block\n", size);
+    abort();
+}
+
+void *pool_alloc(Pool *pool, size_t size) {
+    size_t total = size + sizeof(PoolHeader);
+    int size_class = find_size_class(total);
+    PoolHeader *header;
+    if (size_class == POOL_NUM_CLASSES) {
+        header = malloc(total);
+        if (header == NULL) fail_pool_alloc(size);
+        pool->large_allocs++;
+    } else {
+        if (pool->free_lists[size_class] == NULL && !add_slab(pool, size_class)) fail_pool_alloc(size);
+        PoolFreeBlock *free_block = pool->free_lists[size_class];
+        pool->free_lists[size_class] = free_block->next;
+        header = (PoolHeader *)free_block;
+        total = get_class_size(size_class);
+    }
+    header->size = total;
+    pool->allocs++;
+    pool->live_bytes += total;
+    return header + 1;
+}
+
+void pool_free(Pool *pool, void *block) {
+    if (block == NULL) return;
+    PoolHeader *header = (PoolHeader *)block - 1;
+    size_t size = header->size;
+    pool->frees++;
+    pool->live_bytes -= size;
+    int size_class = find_size_class(size);
+    if (size_class == POOL_NUM_CLASSES) {
+        free(header);
+        return;
+    }
+    PoolFreeBlock *free_block = (PoolFreeBlock *)header;
+    free_block->next = pool->free_lists[size_class];
+    pool->free_lists[size_class] = free_block;
+}
@@ -0,0 +1,50 @@
+/*  This file is part of Cellbowl.
+
+    Cellbowl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Cellbowl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Cellbowl.  If not, see <https://www.gnu.org/licenses/>. 
+    
+    © Tom Rodgers 2010-2019
+*/
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+// blocks come in sizes of a power of two or one and a half times one, from 1 << POOL_MIN_SHIFT
+// bytes up to 4 KB, header included
+#define POOL_MIN_SHIFT 5
+#define POOL_NUM_CLASSES 15
+#define POOL_SLAB_SIZE 65536
+
+// allocator for the small, short-lived blocks that cells are made of. freed blocks go on
+// a free list for their size class and are reused; memory only goes back to the system
+// when the pool is freed. requests larger than the biggest class fall through to malloc
+typedef struct Pool {
+    void *free_lists[POOL_NUM_CLASSES];
+    void *slabs; // every slab carved up so far, linked through their first word
+    // counters for profiling
+    unsigned long long allocs, frees;
+    unsigned long long slab_allocs; // slabs requested from the system
+    unsigned long long large_allocs; // requests too big for a size class
+    unsigned long long live_bytes; // bytes handed out and not yet freed, headers included
+} Pool;
+
+void init_pool(Pool *pool);
+// releases every slab, invalidating all blocks still in use except those too big for a size class
+void free_pool(Pool *pool);
+// never returns NULL. if no memory can be found it says so on stderr and aborts, since the
+// cells and genomes built from blocks have no way to be left without one
+void *pool_alloc(Pool *pool, size_t size);
+void pool_free(Pool *pool, void *block);
+
+#endif
@@ -0,0 +1,124 @@
+/*  This file is part of Cellbowl.
+
+    Cellbowl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Cellbowl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Cellbowl.  If not, see <https://www.gnu.org/licenses/>. 
+    
+    © Tom Rodgers 2010-2019
+*/
+#include <stdlib.h>
+#include <time.h>
+
+#include "profile.h"
+
+const char *profile_phase_names[NUM_PROFILE_PHASES] = {
+    "sort",
+    "hash",
+    "pairs",
+    "integration",
+    "collisions",
+    "walls",
+    "energy",
+    "census",
+    "events",
+    "draw_cells",
+    "draw_hist",
+    "draw_hud",
+    "present"
+};
+
+_Atomic unsigned long long profile_phase_ns[NUM_PROFILE_PHASES];
+
+static unsigned long long profile_window[NUM_PROFILE_PHASES][PROFILE_WINDOW];
+static int profile_window_pos = 0;
+static int profile_window_len = 0;
+static unsigned long profile_frame = 0;
+static FILE *profile_trace = NULL;
+
+unsigned long long get_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void reset_profile(void) {
+    int i;
+    for (i = 0; i < NUM_PROFILE_PHASES; i++) {
+        atomic_store(profile_phase_ns + i, 0);
+    }
+}
+
+void end_profile_frame(void) {
+    int i;
+    // take each total and zero it in one go, so time added meanwhile goes to the next frame
+    unsigned long long frame_ns[NUM_PROFILE_PHASES];
+    for (i = 0; i < NUM_PROFILE_PHASES; i++) {
+        frame_ns[i] = atomic_exchange(profile_phase_ns + i, 0);
+        profile_window[i][profile_window_pos] = frame_ns[i];
+    }
+    profile_window_pos = (profile_window_pos + 1) % PROFILE_WINDOW;
+    if (profile_window_len < PROFILE_WINDOW) {
+        profile_window_len++;
+    }
+    if (profile_trace) {
+        fprintf(profile_trace, "%lu", profile_frame);
+        for (i = 0; i < NUM_PROFILE_PHASES; i++) {
+            fprintf(profile_trace, ",%.3f", frame_ns[i] / 1e3);
+        }
+        fprintf(profile_trace, "\n");
+    }
+    profile_frame++;
+}
+
+static int compare_ns(const void *a, const void *b) {
+    unsigned long long a_ns = *(const unsigned long long *)a;
+    unsigned long long b_ns = *(const unsigned long long *)b;
+    return (a_ns > b_ns) - (a_ns < b_ns);
+}
+
+void get_profile_stats(ProfilePhase phase, double *mean_us, double *p99_us) {
+    int i;
+    unsigned long long sorted[PROFILE_WINDOW];
+    unsigned long long sum = 0;
+    if (!profile_window_len) {
+        *mean_us = 0;
+        *p99_us = 0;
+        return;
+    }
+    for (i = 0; i < profile_window_len; i++) {
+        sorted[i] = profile_window[phase][i];
+        sum += sorted[i];
+    }
+    qsort(sorted, profile_window_len, sizeof(*sorted), compare_ns);
+    *mean_us = sum / 1e3 / profile_window_len;
+    *p99_us = sorted[(profile_window_len * 99 + 99) / 100 - 1] / 1e3;
+}
+
+int open_profile_trace(const char *filename) {
+    int i;
+    close_profile_trace();
+    profile_trace = fopen(filename, "w");
+    if (profile_trace == NULL) return 0;
+    fprintf(profile_trace, "frame");
+    for (i = 0; i < NUM_PROFILE_PHASES; i++) {
+        fprintf(profile_trace, ",%s_us", profile_phase_names[i]);
+    }
+    fprintf(profile_trace, "\n");
+    return 1;
+}
+
+void close_profile_trace(void) {
+    if (profile_trace) {
+        fclose(profile_trace);
+        profile_trace = NULL;
+    }
+}
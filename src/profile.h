@@ -0,0 +1,78 @@
+/*  This file is part of Cellbowl.
+
+    Cellbowl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Cellbowl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Cellbowl.  If not, see <https://www.gnu.org/licenses/>. 
+    
+    © Tom Rodgers 2010-2019
+*/
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+#include <stdatomic.h>
+
+// number of frames kept for the rolling statistics
+#define PROFILE_WINDOW 128
+
+// phases of a simulation step and of a frame timed when built with CELLBOWL_PROFILE
+typedef enum ProfilePhase {
+    PHASE_SORT,
+    PHASE_HASH,
+    PHASE_PAIRS,
+    PHASE_INTEGRATION,
+    PHASE_COLLISIONS,
+    PHASE_WALLS,
+    PHASE_ENERGY,
+    PHASE_CENSUS,
+    // the rest are only timed by the window, never by step_world
+    PHASE_EVENTS,
+    PHASE_DRAW_CELLS,
+    PHASE_DRAW_HIST,
+    PHASE_DRAW_HUD,
+    PHASE_PRESENT,
+    NUM_PROFILE_PHASES
+} ProfilePhase;
+
+// the phases a step is split into come first, so a run without a window has only these to report
+#define NUM_STEP_PROFILE_PHASES PHASE_EVENTS
+
+extern const char *profile_phase_names[NUM_PROFILE_PHASES];
+// nanoseconds spent in each phase since the last call to reset_profile. the simulation thread
+// adds to them while the render thread adds its own phases and takes the totals each frame
+extern _Atomic unsigned long long profile_phase_ns[NUM_PROFILE_PHASES];
+
+// monotonic clock in nanoseconds, available whether or not profiling is built in
+unsigned long long get_time_ns(void);
+void reset_profile(void);
+// moves the phase times of the finished frame into the rolling window, writes them to
+// the trace file if one is open and resets them for the next frame
+void end_profile_frame(void);
+// mean and 99th percentile in microseconds over the frames in the rolling window
+void get_profile_stats(ProfilePhase phase, double *mean_us, double *p99_us);
+// starts streaming per-frame phase times as CSV; returns 0 if the file can't be opened
+int open_profile_trace(const char *filename);
+void close_profile_trace(void);
+
+// PROFILE_BEGIN and PROFILE_END bracket a phase within one block and compile to nothing
+// unless CELLBOWL_PROFILE is defined
+#ifdef CELLBOWL_PROFILE
+#define PROFILE_BEGIN(phase) unsigned long long profile_start_##phase = get_time_ns()
+#define PROFILE_END(phase) atomic_fetch_add(profile_phase_ns + (phase), get_time_ns() - profile_start_##phase)
+#define PROFILE_END_FRAME() end_profile_frame()
+#else
+#define PROFILE_BEGIN(phase)
+#define PROFILE_END(phase)
+#define PROFILE_END_FRAME()
+#endif
+
+#endif
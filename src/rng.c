@@ -0,0 +1,144 @@
+/*  This file is part of Cellbowl.
+
+    Cellbowl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Cellbowl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Cellbowl.  If not, see <https://www.gnu.org/licenses/>. 
+    
+    © Tom Rodgers 2010-2019
+*/
+#include "rng.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+#define PHILOX_ROUNDS 10
+
+void philox4x32(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4]) {
+    int i;
+    uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+    uint32_t k0 = key[0], k1 = key[1];
+    for (i = 0; i < PHILOX_ROUNDS; i++) {
+        uint64_t p0 = (uint64_t)PHILOX_M0 * c0;
+        uint64_t p1 = (uint64_t)PHILOX_M1 * c2;
+        c0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        c2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c1 = (uint32_t)p1;
+        c3 = (uint32_t)p0;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+// the high word of id shares the second word of the counter with other, so a lone id is kept
+// whole. the last word holds the site above the number of the block within the stream
+static void set_counter(uint32_t counter[4], int site, unsigned long step, unsigned long long id,
+        unsigned long long other) {
+    counter[0] = id;
+    counter[1] = (id >> 32) ^ other;
+    counter[2] = step;
+    counter[3] = (uint32_t)site << 24;
+}
+
+void start_random_stream(RandomStream *stream, unsigned long long seed, int site, unsigned long step,
+        unsigned long long id, unsigned long long other) {
+    stream->key[0] = seed;
+    stream->key[1] = seed >> 32;
+    set_counter(stream->counter, site, step, id, other);
+    stream->used = 4;
+}
+
+int next_random(RandomStream *stream) {
+    if (stream->used == 4) {
+        philox4x32(stream->counter, stream->key, stream->block);
+        stream->counter[3]++;
+        stream->used = 0;
+    }
+    return stream->block[stream->used++] >> 1;
+}
+
+#ifdef __SSE2__
+// low and high halves of the products of each lane of a with m
+static void mul_hi_lo(__m128i a, __m128i m, __m128i *hi, __m128i *lo) {
+    __m128i even = _mm_mul_epu32(a, m);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), m);
+    __m128i first = _mm_unpacklo_epi32(even, odd);
+    __m128i second = _mm_unpackhi_epi32(even, odd);
+    *lo = _mm_unpacklo_epi64(first, second);
+    *hi = _mm_unpackhi_epi64(first, second);
+}
+
+// four blocks at once, with lane k of c[w] holding word w of block k
+static void philox4x32_sse2(__m128i c[4], uint32_t key0, uint32_t key1) {
+    int i;
+    __m128i m0 = _mm_set1_epi32(PHILOX_M0);
+    __m128i m1 = _mm_set1_epi32(PHILOX_M1);
+    for (i = 0; i < PHILOX_ROUNDS; i++) {
+        __m128i hi0, lo0, hi1, lo1;
+        mul_hi_lo(c[0], m0, &hi0, &lo0);
+        mul_hi_lo(c[2], m1, &hi1, &lo1);
+        c[0] = _mm_xor_si128(_mm_xor_si128(hi1, c[1]), _mm_set1_epi32(key0));
+        c[2] = _mm_xor_si128(_mm_xor_si128(hi0, c[3]), _mm_set1_epi32(key1));
+        c[1] = lo1;
+        c[3] = lo0;
+        key0 += PHILOX_W0;
+        key1 += PHILOX_W1;
+    }
+}
+#endif
+
+void fill_random_blocks(unsigned long long seed, int site, unsigned long step, const unsigned long long *ids, int n, int *out) {
+    int i = 0, w;
+    uint32_t key[2] = {seed, seed >> 32};
+    uint32_t counter[4];
+    uint32_t block[4];
+#ifdef __SSE2__
+    for (; i + 4 <= n; i += 4) {
+        int k;
+        uint32_t words[4][4];
+        for (k = 0; k < 4; k++) {
+            words[0][k] = ids[i + k];
+            words[1][k] = ids[i + k] >> 32;
+        }
+        set_counter(counter, site, step, 0, 0);
+        __m128i c[4];
+        c[0] = _mm_loadu_si128((const __m128i *)words[0]);
+        c[1] = _mm_loadu_si128((const __m128i *)words[1]);
+        c[2] = _mm_set1_epi32(counter[2]);
+        c[3] = _mm_set1_epi32(counter[3]);
+        philox4x32_sse2(c, key[0], key[1]);
+        for (w = 0; w < 4; w++) {
+            _mm_storeu_si128((__m128i *)words[w], _mm_srli_epi32(c[w], 1));
+        }
+        for (k = 0; k < 4; k++) {
+            for (w = 0; w < 4; w++) {
+                out[4 * (i + k) + w] = words[w][k];
+            }
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        set_counter(counter, site, step, ids[i], 0);
+        philox4x32(counter, key, block);
+        for (w = 0; w < 4; w++) {
+            out[4 * i + w] = block[w] >> 1;
+        }
+    }
+}
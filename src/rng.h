@@ -0,0 +1,55 @@
+/*  This file is part of Cellbowl.
+
+    Cellbowl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Cellbowl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Cellbowl.  If not, see <https://www.gnu.org/licenses/>. 
+    
+    © Tom Rodgers 2010-2019
+*/
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+// what a random number is for, so draws made for different reasons never share a counter
+enum RandomSite {
+    RANDOM_PUSH, // direction and strength of a cell's movement impulse
+    RANDOM_TIMING, // delays between impulses and the strength of a turn
+    RANDOM_METABOLISM, // which substance a cell's waste goes to
+    RANDOM_COLLISION, // nudges and infections between a pair of cells
+    RANDOM_BIRTH, // spawn site and mutation of a child
+    RANDOM_FEED, // which substance a cell is topped up from while the bowl is nearly empty
+    RANDOM_DEATH // which substance a dead cell's debt is taken from
+};
+
+// Philox 4x32-10: a block of four random words is a pure function of a 128-bit counter and a 64-bit
+// key. the key is the world's seed and the counter is made of the site, the step, and the ids of
+// whatever is drawing, so a draw doesn't depend on what else was drawn before it or on which thread
+typedef struct RandomStream {
+    uint32_t key[2];
+    uint32_t counter[4];
+    uint32_t block[4];
+    int used; // words of block already handed out
+} RandomStream;
+
+void philox4x32(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4]);
+// starts the numbers drawn at site on step by id, and other when two things draw together.
+// a lone id counts in full, but two ids only stay apart until cell ids pass four billion
+void start_random_stream(RandomStream *stream, unsigned long long seed, int site, unsigned long step,
+        unsigned long long id, unsigned long long other);
+// next number from 0 to 2^31 - 1, like rand()
+int next_random(RandomStream *stream);
+// the first four numbers of the streams of n ids, four at a time where SIMD is available.
+// out[4 * k] to out[4 * k + 3] are what next_random would give for ids[k] with other 0
+void fill_random_blocks(unsigned long long seed, int site, unsigned long step, const unsigned long long *ids, int n, int *out);
+
+#endif
@@ -0,0 +1,163 @@
+/*  This file is part of Cellbowl.
+
+    Cellbowl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Cellbowl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Cellbowl.  If not, see <https://www.gnu.org/licenses/>. 
+    
+    © Tom Rodgers 2010-2019
+*/
+#include "snapshot.h"
+
+static void release_snapshot(Snapshot *snapshot, Pool *pool) {
+    int i;
+    for (i = 0; i < snapshot->num_cells; i++) {
+        release_genome(snapshot->cells[i].genome, pool);
+        release_genome(snapshot->cells[i].virus, pool);
+    }
+    snapshot->num_cells = 0;
+}
+
+void init_snapshot_buffer(SnapshotBuffer *buffer) {
+    int i;
+    for (i = 0; i < 3; i++) {
+        Snapshot *snapshot = buffer->slots + i;
+        snapshot->cells = NULL;
+        snapshot->num_cells = 0;
+        snapshot->cells_allocated = 0;
+        snapshot->width = AREA_WIDTH;
+        snapshot->height = AREA_HEIGHT;
+        snapshot->max_cells = MAX_CELLS;
+        snapshot->selected = -1;
+        snapshot->total_elapsed = 0;
+        snapshot->substances[0] = snapshot->substances[1] = snapshot->substances[2] = 0;
+        snapshot->bucket_size = AREA_WIDTH;
+        snapshot->cols = snapshot->rows = 1;
+        snapshot->step_time_ns = 0;
+        snapshot->hud_version = 0;
+        snapshot->hist_now = snapshot->hist_oldest = NULL;
+        snapshot->hist_epoch = 0;
+        snapshot->hist_elapsed = 0;
+    }
+    buffer->front = 0;
+    atomic_init(&buffer->middle, 1);
+    buffer->back = 2;
+}
+
+void free_snapshot_buffer(SnapshotBuffer *buffer, Pool *pool) {
+    int i;
+    for (i = 0; i < 3; i++) {
+        release_snapshot(buffer->slots + i, pool);
+        free(buffer->slots[i].cells);
+    }
+}
+
+Snapshot *begin_snapshot(SnapshotBuffer *buffer, Pool *pool) {
+    Snapshot *snapshot = buffer->slots + buffer->back;
+    release_snapshot(snapshot, pool);
+    return snapshot;
+}
+
+void fill_snapshot(Snapshot *snapshot, World *world, CellHandle selected, unsigned long hud_version,
+        unsigned long hist_epoch, unsigned long long step_time_ns) {
+    int i;
+    int num_cells = world->num_cells;
+    if (num_cells > snapshot->cells_allocated) {
+        CellSnapshot *cells = realloc(snapshot->cells, sizeof(*cells) * world->cells_allocated);
+        if (cells) {
+            snapshot->cells = cells;
+            snapshot->cells_allocated = world->cells_allocated;
+        } else {
+            // show as many as there is room for
+            num_cells = snapshot->cells_allocated;
+        }
+    }
+    for (i = 0; i < num_cells; i++) {
+        CellSnapshot *cell = snapshot->cells + i;
+        cell->x = world->kin.x[i];
+        cell->y = world->kin.y[i];
+        cell->prev_x = world->kin.prev_x[i];
+        cell->prev_y = world->kin.prev_y[i];
+        cell->rot = world->kin.rot[i];
+        cell->e = world->cells[i].e;
+        cell->age = world->cells[i].age;
+        cell->state = world->cells[i].state;
+        cell->genome = share_genome(world->cells[i].genome);
+        cell->virus = world->cells[i].virus ? share_genome(world->cells[i].virus) : NULL;
+    }
+    snapshot->num_cells = num_cells;
+    snapshot->selected = find_handle(&world->handles, selected);
+    if (snapshot->selected >= num_cells) {
+        snapshot->selected = -1;
+    }
+    snapshot->width = world->config.width;
+    snapshot->height = world->config.height;
+    snapshot->max_cells = world->config.max_cells;
+    snapshot->total_elapsed = world->total_elapsed;
+    for (i = 0; i < 3; i++) {
+        snapshot->substances[i] = world->substances[i];
+    }
+    snapshot->bucket_size = world->hash.bucket_size;
+    snapshot->cols = world->hash.cols;
+    snapshot->rows = world->hash.rows;
+    snapshot->step_time_ns = step_time_ns;
+    snapshot->hud_version = hud_version;
+    if (snapshot->hist_now == NULL || snapshot->hist_epoch != hist_epoch ||
+            snapshot->hist_elapsed != world->now->total_elapsed) {
+        // enough points to fill the graph, oldest first
+        int num_hist = 0;
+        History *point;
+        for (point = world->now; point && num_hist < HIST_LEN + 1; point = point->past_point) {
+            num_hist++;
+        }
+        for (i = num_hist - 1, point = world->now; i >= 0; i--, point = point->past_point) {
+            snapshot->hist[i] = *point;
+            snapshot->hist[i].past_point = i ? snapshot->hist + i - 1 : NULL;
+            snapshot->hist[i].future_point = i < num_hist - 1 ? snapshot->hist + i + 1 : NULL;
+        }
+        snapshot->hist_now = snapshot->hist + num_hist - 1;
+        snapshot->hist_oldest = snapshot->hist;
+        snapshot->hist_epoch = hist_epoch;
+        snapshot->hist_elapsed = world->now->total_elapsed;
+    }
+}
+
+void publish_snapshot(SnapshotBuffer *buffer) {
+    buffer->back = atomic_exchange(&buffer->middle, buffer->back | SNAPSHOT_FRESH) & ~SNAPSHOT_FRESH;
+}
+
+Snapshot *latest_snapshot(SnapshotBuffer *buffer) {
+    if (atomic_load(&buffer->middle) & SNAPSHOT_FRESH) {
+        buffer->front = atomic_exchange(&buffer->middle, buffer->front) & ~SNAPSHOT_FRESH;
+    }
+    return buffer->slots + buffer->front;
+}
+
+void init_command_queue(CommandQueue *queue) {
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+}
+
+int push_command(CommandQueue *queue, Command command) {
+    unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    if (tail - atomic_load_explicit(&queue->head, memory_order_acquire) == COMMAND_QUEUE_SIZE) return 0;
+    queue->commands[tail % COMMAND_QUEUE_SIZE] = command;
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+int pop_command(CommandQueue *queue, Command *command) {
+    unsigned int head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    if (head == atomic_load_explicit(&queue->tail, memory_order_acquire)) return 0;
+    *command = queue->commands[head % COMMAND_QUEUE_SIZE];
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return 1;
+}
@@ -0,0 +1,108 @@
+/*  This file is part of Cellbowl.
+
+    Cellbowl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Cellbowl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Cellbowl.  If not, see <https://www.gnu.org/licenses/>. 
+    
+    © Tom Rodgers 2010-2019
+*/
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdatomic.h>
+
+#include "world.h"
+
+#define COMMAND_QUEUE_SIZE 256
+
+// what the renderer needs of one cell
+typedef struct CellSnapshot {
+    int x, y, prev_x, prev_y;
+    double rot;
+    long e;
+    int age;
+    int state;
+    Genome *genome; // shared with the world, which never changes a genome once shared
+    Genome *virus;
+} CellSnapshot;
+
+// the world as it was after a step, written by the simulation thread and then only read by the renderer
+typedef struct Snapshot {
+    CellSnapshot *cells; // grown by the writer as the world grows
+    int num_cells, cells_allocated;
+    int width, height; // of the area
+    int max_cells; // population cap, or 0 for none
+    int selected; // index in cells of the selected cell, or -1
+    unsigned long total_elapsed;
+    unsigned long long substances[3];
+    int bucket_size, cols, rows; // layout of the spatial hash, drawn on the minimap
+    unsigned long long step_time_ns; // get_time_ns when the last step was taken, for interpolation
+    unsigned long hud_version; // changes when the selection changes other than by stepping
+    // the last stretch of history, linked like the world's. only copied again when it has changed
+    History hist[HIST_LEN + 1];
+    History *hist_now, *hist_oldest;
+    unsigned long hist_epoch, hist_elapsed;
+} Snapshot;
+
+// three snapshots handed from one writer to one reader without locks. the writer fills the back
+// one while the reader draws the front one, and they swap through the middle one; the reader
+// always gets the newest snapshot published and the writer never waits
+typedef struct SnapshotBuffer {
+    Snapshot slots[3];
+    int back, front; // only touched by the writer and reader respectively
+    atomic_int middle; // index of the middle slot, with SNAPSHOT_FRESH set if the reader hasn't taken it
+} SnapshotBuffer;
+
+#define SNAPSHOT_FRESH 4
+
+typedef enum CommandType {
+    COMMAND_SELECT, // select the cell at (x, y), or start dragging it if it's already selected
+    COMMAND_DRAG, // move the cell being dragged to (x, y)
+    COMMAND_RELEASE, // stop dragging
+    COMMAND_DELETE, // kill the selected cell
+    COMMAND_RESET,
+    COMMAND_SAVE, // save to state file slot
+    COMMAND_LOAD
+} CommandType;
+
+// something the player did that changes the world, sent from the renderer to the simulation thread
+typedef struct Command {
+    CommandType type;
+    int x, y;
+    int slot;
+} Command;
+
+// ring of commands from one writer to one reader, without locks
+typedef struct CommandQueue {
+    Command commands[COMMAND_QUEUE_SIZE];
+    atomic_uint head, tail; // next to read and next to write
+} CommandQueue;
+
+void init_snapshot_buffer(SnapshotBuffer *buffer);
+// gives back the genomes and cells the snapshots hold, once neither thread is using them
+void free_snapshot_buffer(SnapshotBuffer *buffer, Pool *pool);
+// the slot for the writer to fill, with the genomes it held from last time given back
+Snapshot *begin_snapshot(SnapshotBuffer *buffer, Pool *pool);
+// copies what the renderer needs from world. hist_epoch changes whenever the history is replaced
+void fill_snapshot(Snapshot *snapshot, World *world, CellHandle selected, unsigned long hud_version,
+        unsigned long hist_epoch, unsigned long long step_time_ns);
+// makes the slot from begin_snapshot the newest
+void publish_snapshot(SnapshotBuffer *buffer);
+// the newest snapshot published, which stays valid until the next call
+Snapshot *latest_snapshot(SnapshotBuffer *buffer);
+
+void init_command_queue(CommandQueue *queue);
+// return 0 if the queue is full or empty
+int push_command(CommandQueue *queue, Command command);
+int pop_command(CommandQueue *queue, Command *command);
+
+#endif
@@ -0,0 +1,257 @@
+/*  This file is part of Cellbowl.
+
+    Cellbowl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Cellbowl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Cellbowl.  If not, see <https://www.gnu.org/licenses/>. 
+    
+    © Tom Rodgers 2010-2019
+*/
+#include "cell.h"
+#include "spatial.h"
+
+int create_spatial_hash(SpatialHash *hash, int width, int height, int min_bucket_size, int capacity) {
+    // the smallest buckets give the most of them
+    int max_cols = (width + min_bucket_size - 1) / min_bucket_size;
+    int max_rows = (height + min_bucket_size - 1) / min_bucket_size;
+    hash->width = width;
+    hash->height = height;
+    hash->min_bucket_size = min_bucket_size;
+    hash->bucket_size = min_bucket_size;
+    hash->cols = 1;
+    hash->rows = 1;
+    hash->starts = malloc(sizeof(*hash->starts) * ((size_t)max_cols * max_rows + 1));
+    hash->capacity = capacity;
+    hash->entries = malloc(sizeof(*hash->entries) * capacity);
+    hash->radii = malloc(sizeof(*hash->radii) * capacity);
+    hash->max_r = 0;
+    hash->slots = malloc(sizeof(*hash->slots) * capacity);
+    hash->added = malloc(sizeof(*hash->added) * capacity);
+    hash->num_added = 0;
+    hash->stale = 0;
+    hash->num_pairs = 0;
+    hash->pairs_allocated = capacity * 2;
+    hash->pairs = malloc(sizeof(*hash->pairs) * hash->pairs_allocated);
+    if (!(hash->starts && hash->entries && hash->radii && hash->slots && hash->added && hash->pairs)) {
+        free_spatial_hash(hash);
+        return 0;
+    }
+    // a single empty bucket until the first build
+    hash->starts[0] = 0;
+    hash->starts[1] = 0;
+    return 1;
+}
+
+// leaves *array as it was if it can't grow
+static int grow_array(int **array, int capacity) {
+    int *grown = realloc(*array, sizeof(**array) * capacity);
+    if (grown == NULL) return 0;
+    *array = grown;
+    return 1;
+}
+
+int grow_spatial_hash(SpatialHash *hash, int capacity) {
+    if (!(grow_array(&hash->entries, capacity) && grow_array(&hash->radii, capacity) &&
+                grow_array(&hash->slots, capacity) && grow_array(&hash->added, capacity))) {
+        return 0;
+    }
+    hash->capacity = capacity;
+    return 1;
+}
+
+void free_spatial_hash(SpatialHash *hash) {
+    free(hash->starts);
+    free(hash->entries);
+    free(hash->radii);
+    free(hash->slots);
+    free(hash->added);
+    free(hash->pairs);
+}
+
+int spatial_col(const SpatialHash *hash, int x) {
+    int col = x / hash->bucket_size;
+    if (x < 0) return 0;
+    if (col >= hash->cols) return hash->cols - 1;
+    return col;
+}
+
+int spatial_row(const SpatialHash *hash, int y) {
+    int row = y / hash->bucket_size;
+    if (y < 0) return 0;
+    if (row >= hash->rows) return hash->rows - 1;
+    return row;
+}
+
+void get_spatial_range(const SpatialHash *hash, int x0, int y0, int x1, int y1,
+        int *left, int *top, int *right, int *bottom) {
+    // no cell reaches further than half a bucket from its centre
+    *left = spatial_col(hash, x0 - hash->bucket_size / 2);
+    *top = spatial_row(hash, y0 - hash->bucket_size / 2);
+    *right = spatial_col(hash, x1 + hash->bucket_size / 2);
+    *bottom = spatial_row(hash, y1 + hash->bucket_size / 2);
+}
+
+void build_spatial_hash(SpatialHash *hash, Cell *cells, Kinematics *kin, int num_cells) {
+    int i;
+    int max_r = 0;
+    hash->max_r = 0;
+    for (i = 0; i < num_cells; i++) {
+        int r = energy_scale(cells[i].genome->r, cells[i].e);
+        if (r > max_r) {
+            max_r = r;
+        }
+        if (cells[i].genome->r > hash->max_r) {
+            hash->max_r = cells[i].genome->r;
+        }
+    }
+    hash->bucket_size = 2 * max_r;
+    if (hash->bucket_size < hash->min_bucket_size) {
+        hash->bucket_size = hash->min_bucket_size;
+    }
+    // keep about as many buckets as cells so a sparse world isn't mostly empty buckets
+    int sparse_size = sqrt((double)hash->width * hash->height / (num_cells + 1));
+    if (hash->bucket_size < sparse_size) {
+        hash->bucket_size = sparse_size;
+    }
+    hash->cols = (hash->width + hash->bucket_size - 1) / hash->bucket_size;
+    hash->rows = (hash->height + hash->bucket_size - 1) / hash->bucket_size;
+    int num_buckets = hash->cols * hash->rows;
+
+    // count the cells centred in each bucket
+    for (i = 0; i <= num_buckets; i++) {
+        hash->starts[i] = 0;
+    }
+    for (i = 0; i < num_cells; i++) {
+        hash->starts[spatial_row(hash, kin->y[i]) * hash->cols + spatial_col(hash, kin->x[i])]++;
+    }
+    // turn the counts into the end of each bucket's run of entries
+    for (i = 1; i <= num_buckets; i++) {
+        hash->starts[i] += hash->starts[i - 1];
+    }
+    // fill each run from the back, leaving starts at the beginning of each run
+    // and every bucket's indices in increasing order
+    for (i = num_cells - 1; i >= 0; i--) {
+        int slot = --hash->starts[spatial_row(hash, kin->y[i]) * hash->cols + spatial_col(hash, kin->x[i])];
+        hash->entries[slot] = i;
+        hash->slots[i] = slot;
+    }
+    hash->num_added = 0;
+    hash->stale = 0;
+}
+
+void add_spatial_cell(SpatialHash *hash, int id) {
+    hash->slots[id] = -1 - hash->num_added;
+    hash->added[hash->num_added++] = id;
+    hash->stale = 1;
+}
+
+void remove_spatial_cell(SpatialHash *hash, int id) {
+    int slot = hash->slots[id];
+    if (slot >= 0) {
+        hash->entries[slot] = -1;
+    } else {
+        // fill the gap in the added list with its last cell
+        int last = hash->added[--hash->num_added];
+        hash->added[-1 - slot] = last;
+        hash->slots[last] = slot;
+    }
+    hash->stale = 1;
+}
+
+void move_spatial_cell(SpatialHash *hash, int from, int to) {
+    int slot = hash->slots[from];
+    if (slot >= 0) {
+        hash->entries[slot] = to;
+    } else {
+        hash->added[-1 - slot] = to;
+    }
+    hash->slots[to] = slot;
+}
+
+// the neighbouring buckets to the right of and below a bucket
+static const int neighbour_cols[4] = {1, -1, 0, 1};
+static const int neighbour_rows[4] = {0, 1, 1, 1};
+
+static int compare_pairs(const void *p, const void *q) {
+    const CellPair *a = p;
+    const CellPair *b = q;
+    if (a->a != b->a) return a->a < b->a ? -1 : 1;
+    if (a->b != b->b) return a->b < b->b ? -1 : 1;
+    return 0;
+}
+
+void set_spatial_radii(SpatialHash *hash, Cell *cells, int num_cells) {
+    int i;
+    for (i = 0; i < num_cells; i++) {
+        hash->radii[i] = energy_scale(cells[i].genome->r, cells[i].e);
+    }
+}
+
+int add_spatial_pair(SpatialHash *hash, Kinematics *kin, int a, int b) {
+    int dx = kin->x[a] - kin->x[b];
+    int dy = kin->y[a] - kin->y[b];
+    int rs = hash->radii[a] + hash->radii[b];
+    // the sweep pairs cells any distance apart in y, so rule out the far ones before squaring
+    if (abs(dx) >= rs || abs(dy) >= rs) return 1;
+    if (dx * dx + dy * dy >= rs * rs) return 1;
+    if (hash->num_pairs == hash->pairs_allocated) {
+        CellPair *pairs = realloc(hash->pairs, sizeof(*hash->pairs) * hash->pairs_allocated * 2);
+        if (pairs == NULL) return 0;
+        hash->pairs = pairs;
+        hash->pairs_allocated *= 2;
+    }
+    hash->pairs[hash->num_pairs].a = a < b ? a : b;
+    hash->pairs[hash->num_pairs].b = a < b ? b : a;
+    hash->num_pairs++;
+    return 1;
+}
+
+void sort_spatial_pairs(SpatialHash *hash) {
+    int i;
+    for (i = 1; i < hash->num_pairs; i++) {
+        if (compare_pairs(hash->pairs + i - 1, hash->pairs + i) > 0) break;
+    }
+    // pairs found from a list kept in order often need nothing done
+    if (i >= hash->num_pairs) return;
+    qsort(hash->pairs, hash->num_pairs, sizeof(*hash->pairs), compare_pairs);
+}
+
+int find_spatial_pairs(SpatialHash *hash, Cell *cells, Kinematics *kin, int num_cells) {
+    int i, j, k, l, n;
+    int complete = 1;
+    set_spatial_radii(hash, cells, num_cells);
+    hash->num_pairs = 0;
+    // pair each bucket with itself and with the neighbours after it, so every nearby pair is seen once
+    for (j = 0; j < hash->rows; j++) {
+        for (i = 0; i < hash->cols; i++) {
+            int b = j * hash->cols + i;
+            if (hash->starts[b] == hash->starts[b + 1]) continue;
+            for (k = hash->starts[b]; k < hash->starts[b + 1]; k++) {
+                for (l = k + 1; l < hash->starts[b + 1]; l++) {
+                    complete &= add_spatial_pair(hash, kin, hash->entries[k], hash->entries[l]);
+                }
+            }
+            for (n = 0; n < 4; n++) {
+                int ni = i + neighbour_cols[n];
+                int nj = j + neighbour_rows[n];
+                if (ni < 0 || ni >= hash->cols || nj >= hash->rows) continue;
+                int nb = nj * hash->cols + ni;
+                for (k = hash->starts[b]; k < hash->starts[b + 1]; k++) {
+                    for (l = hash->starts[nb]; l < hash->starts[nb + 1]; l++) {
+                        complete &= add_spatial_pair(hash, kin, hash->entries[k], hash->entries[l]);
+                    }
+                }
+            }
+        }
+    }
+    sort_spatial_pairs(hash);
+    return complete;
+}
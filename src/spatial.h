@@ -0,0 +1,84 @@
+/*  This file is part of Cellbowl.
+
+    Cellbowl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Cellbowl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Cellbowl.  If not, see <https://www.gnu.org/licenses/>. 
+    
+    © Tom Rodgers 2010-2019
+*/
+#ifndef SPATIAL_H
+#define SPATIAL_H
+
+#include "constants.h"
+#include "kinematics.h"
+
+struct Cell;
+
+// two cells whose bounding circles overlap, with a < b
+typedef struct CellPair {
+    int a, b;
+} CellPair;
+
+// uniform grid of square buckets over the area holding each cell by its centre, rebuilt every
+// step with a counting sort. buckets are at least as wide as the largest cell, so cells can only
+// touch cells in the same or a neighbouring bucket and the number of candidates stays bounded
+// as density changes
+typedef struct SpatialHash {
+    int width, height; // of the area covered, in pixels
+    int min_bucket_size;
+    int bucket_size; // side of a bucket in pixels
+    int cols, rows;
+    int *starts; // bucket b holds entries[starts[b]] to entries[starts[b + 1] - 1]
+    int *entries; // cell indices grouped by bucket
+    int capacity; // cells the per-cell arrays have room for
+    int *radii; // energy-scaled radius of each cell when the pairs were found
+    int max_r; // largest unscaled radius when built, so no cell reaches further from its centre
+    int *slots; // where each cell index sits in entries, or -1 - its place in added
+    int *added; // cells born since the last build, which queries search in full
+    int num_added;
+    int stale; // cells were added or removed since the last build
+    CellPair *pairs; // result of the last find_spatial_pairs, sorted by a then b
+    int num_pairs, pairs_allocated;
+} SpatialHash;
+
+// a hash over a width by height area with buckets no smaller than min_bucket_size, with room
+// for capacity cells. returns 0 if the arrays could not be allocated
+int create_spatial_hash(SpatialHash *hash, int width, int height, int min_bucket_size, int capacity);
+// makes room for capacity cells. returns 0 if some array could not grow, leaving the capacity as it was
+int grow_spatial_hash(SpatialHash *hash, int capacity);
+void free_spatial_hash(SpatialHash *hash);
+// sizes the buckets to the largest energy-scaled cell, or larger when cells are sparse,
+// and sorts cells 0 to num_cells - 1 into them
+void build_spatial_hash(SpatialHash *hash, struct Cell *cells, Kinematics *kin, int num_cells);
+// lists each pair of cells whose bounding circles overlap exactly once, in an order that
+// doesn't depend on the bucket size. returns 0 if the list couldn't grow and is incomplete
+int find_spatial_pairs(SpatialHash *hash, struct Cell *cells, Kinematics *kin, int num_cells);
+// the pieces of find_spatial_pairs, for other ways of finding the candidates. the radii of
+// cells 0 to num_cells - 1 must be set before pairs are added, and the pairs sorted after
+void set_spatial_radii(SpatialHash *hash, struct Cell *cells, int num_cells);
+// adds a and b to the pairs if their bounding circles overlap. returns 0 if the list couldn't grow
+int add_spatial_pair(SpatialHash *hash, Kinematics *kin, int a, int b);
+void sort_spatial_pairs(SpatialHash *hash);
+// keep the buckets in step with births and deaths until the next build.
+// removed entries are left as -1, which only the census expects to see
+void add_spatial_cell(SpatialHash *hash, int id);
+void remove_spatial_cell(SpatialHash *hash, int id);
+// the cell at index from has been moved to index to
+void move_spatial_cell(SpatialHash *hash, int from, int to);
+// column and row of the bucket containing a point, clamped to the grid
+int spatial_col(const SpatialHash *hash, int x);
+int spatial_row(const SpatialHash *hash, int y);
+// columns and rows of the buckets holding every cell that could overlap the rectangle from (x0, y0) to (x1, y1)
+void get_spatial_range(const SpatialHash *hash, int x0, int y0, int x1, int y1,
+        int *left, int *top, int *right, int *bottom);
+
+#endif
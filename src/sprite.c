@@ -0,0 +1,262 @@
+/*  This file is part of Cellbowl.
+
+    Cellbowl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Cellbowl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Cellbowl.  If not, see <https://www.gnu.org/licenses/>. 
+    
+    © Tom Rodgers 2010-2019
+*/
+#include <math.h>
+
+#include "sprite.h"
+#include "draw.h"
+
+typedef struct SpriteCache {
+    Sprite *buckets[SPRITE_BUCKETS];
+    Sprite *newest, *oldest;
+    size_t bytes, budget;
+    // each new sprite is drawn on the canvas, noting every pixel it touches, and the canvas is
+    // cleared again by going through them. both grow to fit the largest sprite made
+    Uint32 *canvas;
+    int *touched;
+    int canvas_allocated;
+    // organelle offsets of the sprite being made, grown to fit the largest genome seen
+    int *org_locs;
+    int org_locs_allocated;
+} SpriteCache;
+
+static SpriteCache *cache = NULL;
+
+int create_sprite_cache(size_t budget) {
+    free_sprite_cache();
+    if (!budget) return 1;
+    cache = calloc(1, sizeof(SpriteCache));
+    if (cache == NULL) return 0;
+    cache->budget = budget;
+    return 1;
+}
+
+static void unlink_sprite(Sprite *sprite) {
+    if (sprite->newer) {
+        sprite->newer->older = sprite->older;
+    } else {
+        cache->newest = sprite->older;
+    }
+    if (sprite->older) {
+        sprite->older->newer = sprite->newer;
+    } else {
+        cache->oldest = sprite->newer;
+    }
+}
+
+static void link_newest(Sprite *sprite) {
+    sprite->newer = NULL;
+    sprite->older = cache->newest;
+    if (cache->newest) {
+        cache->newest->newer = sprite;
+    } else {
+        cache->oldest = sprite;
+    }
+    cache->newest = sprite;
+}
+
+static unsigned int sprite_bucket(unsigned long genome_id, int rot, int scale, int state) {
+    unsigned long long h = genome_id * 0x9E3779B97F4A7C15ull;
+    h ^= (unsigned long long)((rot * SPRITE_SCALES + scale) * 16 + state + 1) * 0xC2B2AE3D27D4EB4Full;
+    return (h >> 40) & (SPRITE_BUCKETS - 1);
+}
+
+static void evict_oldest(void) {
+    Sprite *sprite = cache->oldest;
+    Sprite **link = cache->buckets + sprite_bucket(sprite->genome_id, sprite->rot, sprite->scale, sprite->state);
+    while (*link != sprite) {
+        link = &(*link)->next;
+    }
+    *link = sprite->next;
+    unlink_sprite(sprite);
+    cache->bytes -= sprite->bytes;
+    free(sprite);
+}
+
+void free_sprite_cache(void) {
+    if (cache == NULL) return;
+    while (cache->oldest) {
+        evict_oldest();
+    }
+    free(cache->canvas);
+    free(cache->touched);
+    free(cache->org_locs);
+    free(cache);
+    cache = NULL;
+}
+
+// rasterizes the cell on the canvas and gathers the pixels it covers into a new sprite
+static Sprite *make_sprite(const Genome *genome, long e, double rot, int state,
+        const Uint32 *type_colors, const Uint32 *state_colors) {
+    int i, j, x, dy;
+    int num_organelles = genome->num_organelles;
+    if (num_organelles * 3 > cache->org_locs_allocated) {
+        int *locs = realloc(cache->org_locs, sizeof(*cache->org_locs) * num_organelles * 3);
+        if (locs == NULL) return NULL;
+        cache->org_locs = locs;
+        cache->org_locs_allocated = num_organelles * 3;
+    }
+    int *org_x = cache->org_locs;
+    int *org_y = cache->org_locs + num_organelles;
+    int *org_r = cache->org_locs + num_organelles * 2;
+    locate_organelles(genome, e, rot, org_x, org_y, org_r);
+    int r = 0;
+    for (i = 0; i < num_organelles; i++) {
+        int extent = (abs(org_x[i]) > abs(org_y[i]) ? abs(org_x[i]) : abs(org_y[i])) + org_r[i];
+        if (extent > r) r = extent;
+    }
+    int size = 2 * r + 1;
+    if (size * size > cache->canvas_allocated) {
+        Uint32 *canvas = calloc(size * size, sizeof(*canvas));
+        int *touched = malloc(sizeof(*touched) * size * size);
+        if (canvas == NULL || touched == NULL) {
+            free(canvas);
+            free(touched);
+            return NULL;
+        }
+        free(cache->canvas);
+        free(cache->touched);
+        cache->canvas = canvas;
+        cache->touched = touched;
+        cache->canvas_allocated = size * size;
+    }
+    Uint32 *canvas = cache->canvas;
+    int num_touched = 0;
+    for (i = 0; i < num_organelles; i++) {
+        Uint32 color;
+        if (state) {
+            color = state > 0 && state < NUM_STATE_COLORS ? state_colors[state] : 0;
+        } else {
+            color = type_colors[genome->organelles[i].type];
+        }
+        if (!color) continue; // transparent
+        int *lo = find_circle_extents(org_r[i]);
+        if (lo == NULL) {
+            num_touched = -1;
+            break;
+        }
+        int *hi = lo + org_r[i] + 1;
+        for (dy = -org_r[i]; dy <= org_r[i]; dy++) {
+            int row = abs(dy);
+            int base = (org_y[i] + r + dy) * size + org_x[i] + r;
+            // the left and right spans of the outline on this row
+            for (j = 0; j < 2; j++) {
+                int x0 = j ? lo[row] : -hi[row];
+                int x1 = j ? hi[row] : -lo[row];
+                for (x = x0; x <= x1; x++) {
+                    if (!canvas[base + x]) {
+                        cache->touched[num_touched++] = base + x;
+                    }
+                    canvas[base + x] = color;
+                }
+            }
+        }
+    }
+
+    Sprite *sprite = NULL;
+    size_t bytes = sizeof(Sprite) + (sizeof(short) * 2 + sizeof(Uint32) + sizeof(int)) * num_touched;
+    if (num_touched >= 0 && bytes <= cache->budget) {
+        sprite = malloc(bytes);
+    }
+    if (sprite) {
+        sprite->r = r;
+        sprite->num_pixels = num_touched;
+        sprite->colors = (Uint32 *)(sprite + 1);
+        sprite->offsets = (int *)(sprite->colors + num_touched);
+        sprite->x = (short *)(sprite->offsets + num_touched);
+        sprite->y = sprite->x + num_touched;
+        sprite->pitch = 0;
+        sprite->bytes = bytes;
+    }
+    for (i = 0; i < num_touched; i++) {
+        int pos = cache->touched[i];
+        if (sprite) {
+            sprite->x[i] = pos % size - r;
+            sprite->y[i] = pos / size - r;
+            sprite->colors[i] = canvas[pos];
+        }
+        canvas[pos] = 0;
+    }
+    return sprite;
+}
+
+int draw_cell_sprite(SDL_Surface *s, int cx, int cy, const Genome *genome, long e, double rot, int state,
+        const Uint32 *type_colors, const Uint32 *state_colors) {
+    int i;
+    if (cache == NULL) return 0;
+    // round the rotation and energy to the steps sprites are made at
+    double turns = rot / (2 * M_PI);
+    int rot_step = (int)floor((turns - floor(turns)) * SPRITE_ROTATIONS + 0.5) % SPRITE_ROTATIONS;
+    double capped_e = e;
+    if (capped_e > 1000000) {
+        capped_e = 1000000;
+    } else if (capped_e < -500000) {
+        capped_e = -500000;
+    }
+    int scale_step = (capped_e + 500000) * SPRITE_SCALES / 1500000 + 0.5;
+
+    Sprite **bucket = cache->buckets + sprite_bucket(genome->id, rot_step, scale_step, state);
+    Sprite *sprite = *bucket;
+    while (sprite && (sprite->genome_id != genome->id || sprite->rot != rot_step ||
+                sprite->scale != scale_step || sprite->state != state)) {
+        sprite = sprite->next;
+    }
+    if (sprite) {
+        unlink_sprite(sprite);
+    } else {
+        sprite = make_sprite(genome, (long)scale_step * 1500000 / SPRITE_SCALES - 500000,
+                rot_step * 2 * M_PI / SPRITE_ROTATIONS, state, type_colors, state_colors);
+        if (sprite == NULL) return 0;
+        sprite->genome_id = genome->id;
+        sprite->rot = rot_step;
+        sprite->scale = scale_step;
+        sprite->state = state;
+        while (cache->bytes + sprite->bytes > cache->budget) {
+            evict_oldest();
+        }
+        // only link it in after evicting, which may change the head of the bucket
+        sprite->next = *bucket;
+        *bucket = sprite;
+        cache->bytes += sprite->bytes;
+    }
+    link_newest(sprite);
+
+    if (cx + sprite->r < 0 || cx - sprite->r >= s->w || cy + sprite->r < 0 || cy - sprite->r >= s->h) return 1;
+    if (cx - sprite->r >= 0 && cx + sprite->r < s->w && cy - sprite->r >= 0 && cy + sprite->r < s->h) {
+        int pitch = s->pitch / sizeof(Uint32);
+        if (sprite->pitch != pitch) {
+            for (i = 0; i < sprite->num_pixels; i++) {
+                sprite->offsets[i] = sprite->y[i] * pitch + sprite->x[i];
+            }
+            sprite->pitch = pitch;
+        }
+        Uint32 *centre = (Uint32 *)((Uint8 *)s->pixels + cy * s->pitch) + cx;
+        for (i = 0; i < sprite->num_pixels; i++) {
+            centre[sprite->offsets[i]] = sprite->colors[i];
+        }
+    } else {
+        // the sprite is partially on the surface, clip each pixel
+        for (i = 0; i < sprite->num_pixels; i++) {
+            int x = cx + sprite->x[i];
+            int y = cy + sprite->y[i];
+            if (x >= 0 && x < s->w && y >= 0 && y < s->h) {
+                ((Uint32 *)((Uint8 *)s->pixels + y * s->pitch))[x] = sprite->colors[i];
+            }
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,57 @@
+/*  This file is part of Cellbowl.
+
+    Cellbowl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Cellbowl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Cellbowl.  If not, see <https://www.gnu.org/licenses/>. 
+    
+    © Tom Rodgers 2010-2019
+*/
+#ifndef SPRITE_H
+#define SPRITE_H
+
+#include <SDL2/SDL.h>
+
+#include "genome.h"
+
+// cells are drawn from sprites cached for their genome, rotation, energy and state, each rotation
+// and energy rounded to one of this many steps
+#define SPRITE_ROTATIONS 128
+#define SPRITE_SCALES 64
+#define SPRITE_BUCKETS 4096
+
+// a cell rasterized once into a list of its opaque pixels, so blitting it skips the transparent ones
+typedef struct Sprite {
+    unsigned long genome_id;
+    short rot, scale;
+    int state;
+    int r; // every pixel lies within r of the centre in both directions
+    int num_pixels;
+    short *x, *y; // offsets from the centre
+    Uint32 *colors;
+    int *offsets; // y * pitch + x for the surface last drawn on
+    int pitch; // in pixels
+    size_t bytes;
+    struct Sprite *newer, *older; // least recently used order
+    struct Sprite *next; // next in the same bucket
+} Sprite;
+
+// sprites are evicted least recently used first to keep their total size within budget bytes;
+// returns 0 if the cache could not be allocated, in which case cells are rasterized directly
+int create_sprite_cache(size_t budget);
+void free_sprite_cache(void);
+// draws a cell with genome, energy e, rotation rot and state centred on cx, cy, using
+// state_colors[state] for every organelle if state is set and type_colors otherwise.
+// returns 0 if it has no sprite to draw it with and the caller should rasterize it
+int draw_cell_sprite(SDL_Surface *s, int cx, int cy, const Genome *genome, long e, double rot, int state,
+        const Uint32 *type_colors, const Uint32 *state_colors);
+
+#endif
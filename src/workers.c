@@ -0,0 +1,110 @@
+/*  This file is part of Cellbowl.
+
+    Cellbowl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Cellbowl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Cellbowl.  If not, see <https://www.gnu.org/licenses/>. 
+    
+    © Tom Rodgers 2010-2019
+*/
+#include "workers.h"
+
+static void *work(void *arg) {
+    Workers *workers = ((WorkerArg *)arg)->workers;
+    int chunk = ((WorkerArg *)arg)->chunk;
+    unsigned long generation = 0;
+    pthread_mutex_lock(&workers->lock);
+    for (;;) {
+        while (workers->generation == generation && !workers->quit) {
+            pthread_cond_wait(&workers->start, &workers->lock);
+        }
+        if (workers->quit) break;
+        generation = workers->generation;
+        WorkFunc func = workers->func;
+        void *data = workers->data;
+        pthread_mutex_unlock(&workers->lock);
+        func(data, chunk, workers->num_threads);
+        pthread_mutex_lock(&workers->lock);
+        if (--workers->busy == 0) {
+            pthread_cond_signal(&workers->done);
+        }
+    }
+    pthread_mutex_unlock(&workers->lock);
+    return NULL;
+}
+
+int create_workers(Workers *workers, int num_threads) {
+    int i;
+    if (num_threads < 1) num_threads = 1;
+    if (num_threads > MAX_WORKERS) num_threads = MAX_WORKERS;
+    workers->num_threads = 1;
+    workers->generation = 0;
+    workers->busy = 0;
+    workers->quit = 0;
+    if (pthread_mutex_init(&workers->lock, NULL)) return 0;
+    if (pthread_cond_init(&workers->start, NULL)) {
+        pthread_mutex_destroy(&workers->lock);
+        return 0;
+    }
+    if (pthread_cond_init(&workers->done, NULL)) {
+        pthread_cond_destroy(&workers->start);
+        pthread_mutex_destroy(&workers->lock);
+        return 0;
+    }
+    for (i = 1; i < num_threads; i++) {
+        workers->args[i].workers = workers;
+        workers->args[i].chunk = i;
+        if (pthread_create(workers->threads + i, NULL, work, workers->args + i)) {
+            free_workers(workers);
+            return 0;
+        }
+        workers->num_threads++;
+    }
+    return 1;
+}
+
+void free_workers(Workers *workers) {
+    int i;
+    pthread_mutex_lock(&workers->lock);
+    workers->quit = 1;
+    pthread_cond_broadcast(&workers->start);
+    pthread_mutex_unlock(&workers->lock);
+    for (i = 1; i < workers->num_threads; i++) {
+        pthread_join(workers->threads[i], NULL);
+    }
+    pthread_cond_destroy(&workers->done);
+    pthread_cond_destroy(&workers->start);
+    pthread_mutex_destroy(&workers->lock);
+}
+
+void run_workers(Workers *workers, WorkFunc func, void *data) {
+    if (workers->num_threads == 1) {
+        func(data, 0, 1);
+        return;
+    }
+    pthread_mutex_lock(&workers->lock);
+    workers->func = func;
+    workers->data = data;
+    workers->busy = workers->num_threads - 1;
+    workers->generation++;
+    pthread_cond_broadcast(&workers->start);
+    pthread_mutex_unlock(&workers->lock);
+    func(data, 0, workers->num_threads);
+    pthread_mutex_lock(&workers->lock);
+    while (workers->busy) {
+        pthread_cond_wait(&workers->done, &workers->lock);
+    }
+    pthread_mutex_unlock(&workers->lock);
+}
+
+int chunk_start(int n, int chunk, int num_chunks) {
+    return (long)n * chunk / num_chunks;
+}
@@ -0,0 +1,61 @@
+/*  This file is part of Cellbowl.
+
+    Cellbowl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Cellbowl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Cellbowl.  If not, see <https://www.gnu.org/licenses/>. 
+    
+    © Tom Rodgers 2010-2019
+*/
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include <pthread.h>
+
+#define MAX_WORKERS 64
+
+// work split into num_chunks pieces, of which this call should do piece chunk
+typedef void (*WorkFunc)(void *data, int chunk, int num_chunks);
+
+struct Workers;
+
+// what each thread is started with
+typedef struct WorkerArg {
+    struct Workers *workers;
+    int chunk;
+} WorkerArg;
+
+// threads that live as long as the world and wait to be handed work, so that a step
+// doesn't pay for starting threads. the thread that calls run_workers does chunk 0 itself
+typedef struct Workers {
+    int num_threads; // including the calling thread
+    pthread_t threads[MAX_WORKERS];
+    WorkerArg args[MAX_WORKERS];
+    pthread_mutex_t lock;
+    pthread_cond_t start, done;
+    WorkFunc func;
+    void *data;
+    unsigned long generation; // counts calls to run_workers so sleeping threads know there's new work
+    int busy; // threads still working on the current call
+    int quit;
+} Workers;
+
+// starts num_threads - 1 threads, clamped to between 1 and MAX_WORKERS in total. the threads
+// keep pointers into workers, so it mustn't move. returns 0 if they could not be started
+int create_workers(Workers *workers, int num_threads);
+void free_workers(Workers *workers);
+// calls func once for every chunk, one per thread, and returns when all of them have finished
+void run_workers(Workers *workers, WorkFunc func, void *data);
+// first index of a chunk when n items are split evenly, so chunk c covers
+// chunk_start(n, c, num_chunks) to chunk_start(n, c + 1, num_chunks) - 1
+int chunk_start(int n, int chunk, int num_chunks);
+
+#endif
@@ -0,0 +1,448 @@
+/*  This file is part of Cellbowl.
+
+    Cellbowl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Cellbowl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Cellbowl.  If not, see <https://www.gnu.org/licenses/>. 
+    
+    © Tom Rodgers 2010-2019
+*/
+#include <string.h>
+
+#include "world.h"
+
+static void count_types(World *world, int total_counts[NUM_TYPES]) {
+    int i, j;
+    for (i = 0; i < NUM_TYPES; i++) {
+        total_counts[i] = 0;
+        for (j = 0; j < world->num_cells; j++) {
+            total_counts[i] += world->cells[j].genome->type_counts[i];
+        }
+    }
+}
+
+void default_world_config(WorldConfig *config) {
+    config->width = AREA_WIDTH;
+    config->height = AREA_HEIGHT;
+    config->max_cells = MAX_CELLS;
+    config->capacity = MAX_CELLS;
+    config->min_bucket_size = SPATIAL_MIN_BUCKET_SIZE;
+    config->sort_steps = DEFAULT_SORT_STEPS;
+    config->broadphase = BROADPHASE_GRID;
+    config->skin = DEFAULT_SKIN;
+}
+
+int parse_world_option(WorldConfig *config, int argc, char *argv[], int *i) {
+    if (*i + 1 >= argc) return 0;
+    if (!strcmp(argv[*i], "--width")) {
+        config->width = strtol(argv[++*i], NULL, 10);
+    } else if (!strcmp(argv[*i], "--height")) {
+        config->height = strtol(argv[++*i], NULL, 10);
+    } else if (!strcmp(argv[*i], "--max-cells")) {
+        config->max_cells = strtol(argv[++*i], NULL, 10);
+    } else if (!strcmp(argv[*i], "--capacity")) {
+        config->capacity = strtol(argv[++*i], NULL, 10);
+    } else if (!strcmp(argv[*i], "--min-bucket")) {
+        config->min_bucket_size = strtol(argv[++*i], NULL, 10);
+    } else if (!strcmp(argv[*i], "--sort-steps")) {
+        config->sort_steps = strtol(argv[++*i], NULL, 10);
+    } else if (!strcmp(argv[*i], "--broadphase")) {
+        config->broadphase = find_broadphase(argv[++*i]);
+    } else if (!strcmp(argv[*i], "--skin")) {
+        config->skin = strtol(argv[++*i], NULL, 10);
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+void print_world_options(FILE *fp) {
+    fprintf(fp, "  --width PX     width of the bowl (default %d)\n"
+            "  --height PX    height of the bowl (default %d)\n"
+            "  --max-cells N  population at which births stop, 0 for no limit (default %d)\n"
+            "  --capacity N   cells to allocate room for up front, grown as needed (default %d)\n"
+            "  --min-bucket N smallest side of a spatial hash bucket in pixels (default %d)\n"
+            "  --sort-steps N steps between sorting cells by position, 0 for never (default %d)\n"
+            "  --broadphase B how to find cells that might touch: grid, verlet or sweep (default grid)\n"
+            "  --skin PX      margin of the verlet neighbour lists (default %d)\n",
+            AREA_WIDTH, AREA_HEIGHT, MAX_CELLS, MAX_CELLS, SPATIAL_MIN_BUCKET_SIZE, DEFAULT_SORT_STEPS, DEFAULT_SKIN);
+}
+
+int check_world_config(const WorldConfig *config) {
+    if (config->width <= 0 || config->height <= 0 || config->max_cells < 0 || config->capacity < 0 ||
+            config->min_bucket_size <= 0 || config->sort_steps < 0 || config->broadphase < 0 || config->skin < 0) {
+        return 0;
+    }
+    // the finest grid of buckets has to be countable
+    long long cols = (config->width + config->min_bucket_size - 1) / config->min_bucket_size;
+    long long rows = (config->height + config->min_bucket_size - 1) / config->min_bucket_size;
+    return cols * rows < INT_MAX;
+}
+
+static void init_world(World *world) {
+    int i;
+    world->total_elapsed = 0;
+    world->steps = 0;
+    for (i = 0; i < 3; i++) {
+        world->substances[i] = SUBSTANCE_START;
+    }
+    world->num_cells = (world->config.width / CELL_SPACE) * (world->config.height / CELL_SPACE);
+    clear_handles(&world->handles);
+    invalidate_broadphase(&world->broadphase);
+    add_initial_cells(world->cells, &world->kin, &world->pool, &world->handles, world->config.width,
+            world->config.height);
+    int total_counts[NUM_TYPES];
+    count_types(world, total_counts);
+    create_hist(&world->now, world->total_elapsed, world->num_cells, total_counts, world->substances, &world->oldest);
+}
+
+World *create_world(const WorldConfig *config, int num_threads, unsigned long long seed) {
+    World *world = malloc(sizeof(World));
+    if (world == NULL) return NULL;
+    world->config = *config;
+    // at least enough for the initial grid
+    world->cells_allocated = (config->width / CELL_SPACE) * (config->height / CELL_SPACE);
+    if (world->cells_allocated < config->capacity) {
+        world->cells_allocated = config->capacity;
+    }
+    if (world->cells_allocated < 1) {
+        world->cells_allocated = 1;
+    }
+    world->cells = malloc(sizeof(*world->cells) * world->cells_allocated);
+    if (world->cells == NULL) {
+        free(world);
+        return NULL;
+    }
+    if (!create_handle_table(&world->handles, world->cells_allocated)) {
+        free(world->cells);
+        free(world);
+        return NULL;
+    }
+    if (!create_kinematics(&world->kin, world->cells_allocated)) {
+        free_handle_table(&world->handles);
+        free(world->cells);
+        free(world);
+        return NULL;
+    }
+    if (!create_spatial_hash(&world->hash, config->width, config->height, config->min_bucket_size,
+                world->cells_allocated)) {
+        free_kinematics(&world->kin);
+        free_handle_table(&world->handles);
+        free(world->cells);
+        free(world);
+        return NULL;
+    }
+    if (!create_broadphase(&world->broadphase, config->broadphase, config->width, config->height,
+                config->min_bucket_size, config->skin, world->cells_allocated)) {
+        free_spatial_hash(&world->hash);
+        free_kinematics(&world->kin);
+        free_handle_table(&world->handles);
+        free(world->cells);
+        free(world);
+        return NULL;
+    }
+    if (!create_collisions(&world->collisions, world->cells_allocated)) {
+        free_broadphase(&world->broadphase);
+        free_spatial_hash(&world->hash);
+        free_kinematics(&world->kin);
+        free_handle_table(&world->handles);
+        free(world->cells);
+        free(world);
+        return NULL;
+    }
+    if (!create_workers(&world->workers, num_threads)) {
+        free_collisions(&world->collisions);
+        free_broadphase(&world->broadphase);
+        free_spatial_hash(&world->hash);
+        free_kinematics(&world->kin);
+        free_handle_table(&world->handles);
+        free(world->cells);
+        free(world);
+        return NULL;
+    }
+    init_pool(&world->pool);
+    world->seed = seed;
+    init_world(world);
+    return world;
+}
+
+void free_world(World *world) {
+    int i;
+    free_hist(world->now, world->oldest);
+    free_workers(&world->workers);
+    free_collisions(&world->collisions);
+    free_broadphase(&world->broadphase);
+    free_spatial_hash(&world->hash);
+    for (i = 0; i < world->num_cells; i++) {
+        free_cell(world->cells + i, &world->pool);
+    }
+    free_pool(&world->pool);
+    free_kinematics(&world->kin);
+    free_handle_table(&world->handles);
+    free(world->cells);
+    free(world);
+}
+
+void reset_world(World *world) {
+    int i;
+    for (i = 0; i < world->num_cells; i++) {
+        free_cell(world->cells + i, &world->pool);
+    }
+    free_hist(world->now, world->oldest);
+    init_world(world);
+}
+
+void hash_cells(World *world) {
+    build_spatial_hash(&world->hash, world->cells, &world->kin, world->num_cells);
+}
+
+int reserve_cells(World *world, int num_cells) {
+    if (num_cells <= world->cells_allocated) return 1;
+    int capacity = world->cells_allocated * 2;
+    if (capacity < num_cells) {
+        capacity = num_cells;
+    }
+    if (world->config.max_cells && capacity > world->config.max_cells) {
+        capacity = num_cells > world->config.max_cells ? num_cells : world->config.max_cells;
+    }
+    if (!grow_kinematics(&world->kin, capacity) || !grow_spatial_hash(&world->hash, capacity) ||
+            !grow_broadphase(&world->broadphase, capacity) || !grow_handle_table(&world->handles, capacity)) {
+        return 0;
+    }
+    Cell *cells = realloc(world->cells, sizeof(*cells) * capacity);
+    if (cells == NULL) return 0;
+    world->cells = cells;
+    world->cells_allocated = capacity;
+    return 1;
+}
+
+// spreads the low 16 bits of x out to the even bits
+static unsigned int spread_bits(unsigned int x) {
+    x &= 0xffff;
+    x = (x | (x << 8)) & 0x00ff00ff;
+    x = (x | (x << 4)) & 0x0f0f0f0f;
+    x = (x | (x << 2)) & 0x33333333;
+    x = (x | (x << 1)) & 0x55555555;
+    return x;
+}
+
+static unsigned int morton_code(int x, int y) {
+    x >>= MORTON_SHIFT;
+    y >>= MORTON_SHIFT;
+    // cells pushed just outside the bowl go with the edge
+    if (x < 0) x = 0;
+    if (y < 0) y = 0;
+    return spread_bits(x) | spread_bits(y) << 1;
+}
+
+void sort_cells(World *world) {
+    int i, pass;
+    int n = world->num_cells;
+    if (n < 2) return;
+    // the key is the code above the index, so cells with the same code keep their order
+    unsigned long long *keys = malloc(sizeof(*keys) * n * 2);
+    int *order = malloc(sizeof(*order) * n);
+    void *scratch = malloc((sizeof(Cell) > sizeof(double) ? sizeof(Cell) : sizeof(double)) * n);
+    if (!(keys && order && scratch)) {
+        free(keys);
+        free(order);
+        free(scratch);
+        return;
+    }
+    int sorted = 1;
+    for (i = 0; i < n; i++) {
+        keys[i] = (unsigned long long)morton_code(world->kin.x[i], world->kin.y[i]) << 32 | i;
+        if (i && keys[i] < keys[i - 1]) {
+            sorted = 0;
+        }
+    }
+    if (!sorted) {
+        // least significant byte of the code first, stable from pass to pass
+        unsigned long long *from = keys;
+        unsigned long long *to = keys + n;
+        for (pass = 0; pass < 4; pass++) {
+            int shift = 32 + 8 * pass;
+            int counts[257] = {0};
+            for (i = 0; i < n; i++) {
+                counts[(from[i] >> shift & 0xff) + 1]++;
+            }
+            for (i = 1; i < 256; i++) {
+                counts[i] += counts[i - 1];
+            }
+            for (i = 0; i < n; i++) {
+                to[counts[from[i] >> shift & 0xff]++] = from[i];
+            }
+            unsigned long long *swap = from;
+            from = to;
+            to = swap;
+        }
+        for (i = 0; i < n; i++) {
+            order[i] = (int)(keys[i] & 0xffffffff);
+        }
+        Cell *cells = (Cell *)scratch;
+        for (i = 0; i < n; i++) {
+            cells[i] = world->cells[order[i]];
+        }
+        memcpy(world->cells, cells, sizeof(*cells) * n);
+        permute_kinematics(&world->kin, order, n, scratch);
+        for (i = 0; i < n; i++) {
+            move_handle(&world->handles, world->cells[i].handle, i);
+        }
+    }
+    free(keys);
+    free(order);
+    free(scratch);
+}
+
+// the most children the census could have. a cell with enough energy has one child, which
+// takes half of it and may be left with enough to have one of its own, and so on
+static int count_possible_births(World *world) {
+    int i;
+    int births = 0;
+    for (i = 0; i < world->num_cells; i++) {
+        long e;
+        for (e = world->cells[i].e; e >= 1000000; e /= 2) {
+            births++;
+        }
+    }
+    return births;
+}
+
+int step_world(World *world, int elapsed) {
+    int i;
+    if (world->config.sort_steps && world->steps % world->config.sort_steps == 0) {
+        PROFILE_BEGIN(PHASE_SORT);
+        sort_cells(world);
+        PROFILE_END(PHASE_SORT);
+    }
+    int max_cells = world->num_cells + count_possible_births(world);
+    if (world->config.max_cells && max_cells > world->config.max_cells) {
+        max_cells = world->config.max_cells;
+    }
+    if (!reserve_cells(world, max_cells)) {
+        // without the memory, births stop where the room runs out
+        max_cells = world->cells_allocated;
+    }
+    for (i = 0; i < world->num_cells; i++) {
+        world->kin.prev_x[i] = world->kin.x[i];
+        world->kin.prev_y[i] = world->kin.y[i];
+    }
+    if (world->total_elapsed + elapsed > ULONG_MAX) {
+        world->total_elapsed -= ULONG_MAX;
+    }
+    world->total_elapsed += elapsed;
+    // the census finds room for children in a hash of the cells as they are now
+    PROFILE_BEGIN(PHASE_HASH);
+    hash_cells(world);
+    PROFILE_END(PHASE_HASH);
+    PROFILE_BEGIN(PHASE_CENSUS);
+    census_cells(world->cells, &world->kin, &world->num_cells, max_cells, &world->hash, &world->handles,
+            &world->pool, world->substances, world->seed, world->steps);
+    PROFILE_END(PHASE_CENSUS);
+    int complete = adjust_cells(world->cells, &world->kin, world->num_cells, &world->hash, &world->broadphase, &world->handles,
+            &world->collisions, &world->workers, world->substances, elapsed, world->seed, world->steps);
+    // the grid builds the hash again as it finds the pairs. otherwise it still has the census's
+    // births and deaths in it, and selecting a cell between steps needs every cell in its buckets
+    if (world->hash.stale) {
+        PROFILE_BEGIN(PHASE_HASH);
+        hash_cells(world);
+        PROFILE_END(PHASE_HASH);
+    }
+    world->steps++;
+    return complete;
+}
+
+void record_hist(World *world) {
+    if (world->total_elapsed >= world->now->total_elapsed + HIST_UPDATE_INTERVAL) {
+        int total_counts[NUM_TYPES];
+        count_types(world, total_counts);
+        update_hist(&world->now, world->total_elapsed, world->num_cells, total_counts, world->substances, &world->oldest);
+    }
+}
+
+void save_state(World *world, int slot_num) {
+    char filename[16];
+    sprintf(filename, "state%1d", slot_num);
+    save_state_file(world, filename);
+}
+
+int load_state(World *world, int slot_num) {
+    char filename[16];
+    sprintf(filename, "state%1d", slot_num);
+    return load_state_file(world, filename);
+}
+
+int save_state_file(World *world, const char *filename) {
+    int i;
+    FILE *fp;
+    fp = fopen(filename, "w");
+    if (fp == NULL) return 0;
+    fprintf(fp, "%ld\n", world->total_elapsed);
+    for (i = 0; i < 3; i++) {
+        fprintf(fp, "%" SCNu64 "\n", world->substances[i]);
+    }
+    fprintf(fp, "%d\n", world->num_cells);
+    for (i = 0; i < world->num_cells; i++) {
+        save_cell(fp, world->cells + i, &world->kin, i);
+        if (world->cells[i].virus) {
+            fprintf(fp, "1\n");
+            save_virus(fp, world->cells[i].virus);
+        } else {
+            fprintf(fp, "0\n");
+        }
+    }
+    save_hist(fp, world->now);
+    fclose(fp);
+    return 1;
+}
+
+int load_state_file(World *world, const char *filename) {
+    int i;
+    FILE *fp;
+    fp = fopen(filename, "r");
+    if (fp == NULL) return 0;
+    unsigned long total_elapsed;
+    unsigned long long substances[3];
+    int num_cells;
+    fscanf(fp, "%lu\n", &total_elapsed);
+    for (i = 0; i < 3; i++) {
+        fscanf(fp, "%" SCNu64 "\n", substances + i);
+    }
+    if (fscanf(fp, "%d\n", &num_cells) != 1 || num_cells < 0 || !reserve_cells(world, num_cells)) {
+        fclose(fp);
+        return 0;
+    }
+    for (i = 0; i < world->num_cells; i++) {
+        free_cell(world->cells + i, &world->pool);
+    }
+    free_hist(world->now, world->oldest);
+    world->total_elapsed = total_elapsed;
+    for (i = 0; i < 3; i++) {
+        world->substances[i] = substances[i];
+    }
+    world->num_cells = num_cells;
+    clear_handles(&world->handles);
+    invalidate_broadphase(&world->broadphase);
+    for (i = 0; i < world->num_cells; i++) {
+        load_cell(fp, world->cells + i, &world->kin, i, &world->pool);
+        register_cell(world->cells + i, &world->handles, i);
+        create_organelle_locs(world->cells + i, &world->pool);
+        int cell_infected;
+        fscanf(fp, "%d\n", &cell_infected);
+        if (cell_infected) {
+            world->cells[i].virus = load_virus(fp, &world->pool);
+        }
+    }
+    load_hist(fp, &world->now, &world->oldest);
+    fclose(fp);
+    world->steps = 0;
+    return 1;
+}
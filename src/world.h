@@ -0,0 +1,93 @@
+/*  This file is part of Cellbowl.
+
+    Cellbowl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Cellbowl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Cellbowl.  If not, see <https://www.gnu.org/licenses/>. 
+    
+    © Tom Rodgers 2010-2019
+*/
+#ifndef WORLD_H
+#define WORLD_H
+
+#include <limits.h>
+
+#include "cell.h"
+#include "graph.h"
+#include "spatial.h"
+#include "broadphase.h"
+#include "constants.h"
+
+// the size of a world, fixed when it's created
+typedef struct WorldConfig {
+    int width, height; // of the area in pixels
+    int max_cells; // no children are born once there are this many cells, or 0 for no limit
+    int capacity; // cells to make room for up front, grown geometrically beyond
+    int min_bucket_size; // smallest side of a spatial hash bucket in pixels
+    int sort_steps; // steps between sorting the cells by position, or 0 to leave them in birth order
+    BroadphaseKind broadphase; // how the pairs of cells that might touch are found
+    int skin; // margin of the neighbour lists in pixels
+} WorldConfig;
+
+typedef struct World {
+    Cell *cells;
+    Kinematics kin;
+    int num_cells;
+    int cells_allocated; // room in cells, kin, hash, broadphase and handles, which grow together
+    HandleTable handles; // finds cells by handle wherever they have moved to
+    WorldConfig config;
+    SpatialHash hash;
+    Broadphase broadphase;
+    Collisions collisions;
+    Pool pool; // genomes and organelle offsets of every cell
+    Workers workers; // threads the step is split across
+    unsigned long long substances[3];
+    unsigned long long seed; // key of every random number drawn while stepping
+    unsigned long total_elapsed;
+    unsigned long steps; // number of calls to step_world since the world was created or loaded
+    History *now, *oldest;
+} World;
+
+// the classic bowl
+void default_world_config(WorldConfig *config);
+// reads the option at argv[*i] into config if it is one, moving *i past its value. returns 0 if it isn't
+int parse_world_option(WorldConfig *config, int argc, char *argv[], int *i);
+// describes the options parse_world_option reads
+void print_world_options(FILE *fp);
+// returns 0 if config can't describe a world
+int check_world_config(const WorldConfig *config);
+// allocates a world populated with the initial grid of random cells, stepped on num_threads threads.
+// the initial grid comes from rand(), and everything after from seed
+World *create_world(const WorldConfig *config, int num_threads, unsigned long long seed);
+void free_world(World *world);
+// discards all cells and history and starts over with the initial grid
+void reset_world(World *world);
+// rebuilds the spatial hash after cells have moved, been born or died
+void hash_cells(World *world);
+// makes room for at least num_cells cells, growing geometrically. cells only moves if everything
+// else grew too. returns 0 if there isn't the memory, leaving the room there was
+int reserve_cells(World *world, int num_cells);
+// reorders the cells along a Z-order curve through their positions, so cells near each other in
+// the bowl are mostly near each other in memory. handles still find them
+void sort_cells(World *world);
+// advances the simulation by elapsed milliseconds. cells may move, so find them again by handle afterwards.
+// returns 0 if there wasn't the memory to collide every pair of cells that touched
+int step_world(World *world, int elapsed);
+// adds a history point if enough time has passed since the last one
+void record_hist(World *world);
+// save and load the state file for a numbered slot in the working directory
+void save_state(World *world, int slot_num);
+// returns 0 if the state file could not be opened or its cells don't fit, leaving the world unchanged
+int load_state(World *world, int slot_num);
+int save_state_file(World *world, const char *filename);
+int load_state_file(World *world, const char *filename);
+
+#endif